@@ -1,6 +1,101 @@
 #include "Actor.h"
 #include "StudentWorld.h"
 
+// Actor Methods
+Actor::Actor(StudentWorld* world, int imageID, int startX, int startY, int startDirection, int depth, double size) :
+	GraphObject(imageID, startX, startY, startDirection, depth, size), m_world(world->getWorldSlot()), m_alive(true),
+	m_spawnOrder(0) {}
+
+int Actor::registerWorld(StudentWorld* world) {
+	std::vector<StudentWorld*>& table = worlds();
+	for (size_t i = 0; i < table.size(); i++) { // reuse a slot if some world gave one back
+		if (table[i] == nullptr) {
+			table[i] = world;
+			return static_cast<int>(i);
+		}
+	}
+	if (table.size() >= MAX_WORLDS) // out of slots, the world gets to say so when it's asked to load a level
+		return -1;
+	table.push_back(world);
+	return static_cast<int>(table.size()) - 1;
+}
+
+void Actor::unregisterWorld(int slot) {
+	worlds()[slot] = nullptr;
+}
+
+void Actor::moveTo(int x, int y) {
+	if (getWorld()->deferringChanges()) { // in a parallel update nobody moves until everyone has had a look at the world
+		getWorld()->postMove(this, x, y);
+		return;
+	}
+	int oldX = getX();
+	int oldY = getY();
+	GraphObject::moveTo(x, y);
+	getWorld()->actorMoved(this, oldX, oldY); // let the world know so it can rebucket us
+}
+
+// deleted actors, linked through their first bytes, with a list for every size up to MAX_POOLED bytes (they're all
+// multiples of a pointer). every thread keeps its own lists so worlds moving on different threads never share one. an
+// actor deleted on some other thread than it was made on just joins that thread's list
+struct FreeActor {
+	FreeActor* next;
+};
+static const size_t MAX_POOLED = 8 * sizeof(void*);
+static thread_local FreeActor* t_freeActors[MAX_POOLED / sizeof(void*) + 1] = {};
+static thread_local bool t_poolClosed = false; // this thread is exiting and its lists have gone back to the heap
+
+// gives the lists back when its thread exits. only gets constructed once the thread first puts something on one
+static struct ActorPoolDrain {
+	~ActorPoolDrain() {
+		for (size_t i = 0; i < sizeof(t_freeActors) / sizeof(t_freeActors[0]); i++) {
+			while (t_freeActors[i] != nullptr) {
+				FreeActor* block = t_freeActors[i];
+				t_freeActors[i] = block->next;
+				::operator delete(block);
+			}
+		}
+		t_poolClosed = true; // anything deleted after this (a world torn down late) goes straight to the heap
+	}
+} thread_local t_poolDrain;
+
+static bool pooled(size_t size) {
+	return size <= MAX_POOLED && size % sizeof(void*) == 0;
+}
+
+void* Actor::operator new(size_t size) {
+	if (!pooled(size) || t_freeActors[size / sizeof(void*)] == nullptr) // too big to bother, or nothing to reuse
+		return ::operator new(size);
+	FreeActor*& list = t_freeActors[size / sizeof(void*)];
+	FreeActor* block = list;
+	list = block->next;
+	return block;
+}
+
+void Actor::operator delete(void* p, size_t size) {
+	if (p == nullptr)
+		return;
+	if (!pooled(size) || t_poolClosed) {
+		::operator delete(p);
+		return;
+	}
+	(void)&t_poolDrain; // touching it is what gets it constructed (and so destroyed) on this thread
+	FreeActor*& list = t_freeActors[size / sizeof(void*)];
+	FreeActor* block = static_cast<FreeActor*>(p);
+	block->next = list;
+	list = block;
+}
+
+void Actor::setAlive(bool status) {
+	if (m_alive && !status && getWorld()->deferringChanges()) { // same goes for dying
+		getWorld()->postDeath(this);
+		return;
+	}
+	if (m_alive && !status)
+		getWorld()->actorDied(this);
+	m_alive = status;
+}
+
 // Peach Methods
 void Peach::doSomething() {
 	if (!isAlive()) // dont do anything if we are dead
@@ -15,30 +110,27 @@ void Peach::doSomething() {
 		shootCooldown--;
 
 	// check if peach is overlapping anything
-	Actor* enemy = getWorld()->isBlockingObject(getX(), getY(), false, false);
-	if (enemy != nullptr && enemy->isAlive() && enemy->isDamageable() && starBoost > 0) {
+	Actor* enemy = getWorld()->findOverlap(getX(), getY(), KIND_DAMAGEABLE);
+	if (enemy != nullptr && starBoost > 0) {
 		// if peach has star power, kill whatever it overlaps
-		getWorld()->playSound(SOUND_PLAYER_KICK);
-		enemy->bonk();
+		getWorld()->postSound(SOUND_PLAYER_KICK);
+		getWorld()->postBonk(enemy);
 	}
 
+	// work out where she ends up in x and y, and only actually move her once at the end
+	int x = getX();
+	int y = getY();
 	if (jumpDistance > 0) { // if jumping, move peach up
-		Actor* above = getWorld()->isBlockingObject(getX(), getY() + SPRITE_HEIGHT / 2);
-		if (above != nullptr && above->isCollidable()) { // if she hits a ceiling, bonk the ceiling
-			above->bonk();
+		Actor* above = getWorld()->sweep(x, y, 0, SPRITE_HEIGHT / 2, KIND_COLLIDABLE);
+		if (above != nullptr) { // if she hits a ceiling, bonk the ceiling
+			getWorld()->postBonk(above);
 			jumpDistance = 0;
 		}
 		else
-		{
-			moveTo(getX(), getY() + SPRITE_HEIGHT / 2); // otherwise, move her up
 			jumpDistance -= 1;
-		}
-	}
-	else { // falling down
-		Actor* below = getWorld()->isBlockingObject(getX(), getY() - SPRITE_HEIGHT / 2);
-		if (!(below != nullptr && below->isCollidable()))  // if there is no ground below, move down
-			moveTo(getX(), getY() - SPRITE_HEIGHT / 2);
 	}
+	else // falling down, until she lands on something
+		getWorld()->sweep(x, y, 0, -SPRITE_HEIGHT / 2, KIND_COLLIDABLE);
 
 	int key; // input
 	Actor* collided = nullptr; // if we bump into anything
@@ -47,20 +139,16 @@ void Peach::doSomething() {
 		switch (key) {
 		case (KEY_PRESS_LEFT):
 			setDirection(180); // make peach face left
-			collided = getWorld()->isBlockingObject(getX() - SPRITE_WIDTH / 2, getY()); // check if she would bump into anything
-			if (collided == nullptr || !collided->isCollidable())
-				moveTo(getX() - SPRITE_WIDTH / 2, getY()); // if not, move her left
+			collided = getWorld()->sweep(x, y, -SPRITE_WIDTH / 2, 0, KIND_COLLIDABLE); // move her left until she bumps into anything
 			break;
 		case (KEY_PRESS_RIGHT):
 			setDirection(0); // make peach face right
-			collided = getWorld()->isBlockingObject(getX() + SPRITE_WIDTH / 2, getY()); // check if she bumps into anything
-			if (collided == nullptr || !collided->isCollidable())
-				moveTo(getX() + SPRITE_WIDTH / 2, getY());	//if not move her right
+			collided = getWorld()->sweep(x, y, SPRITE_WIDTH / 2, 0, KIND_COLLIDABLE); // move her right until she bumps into anything
 			break;
 		case (KEY_PRESS_UP):
-			collided = getWorld()->isBlockingObject(getX(), getY() - SPRITE_HEIGHT / 2); // check if there is floor below her
-			if (collided != nullptr && collided->isCollidable()) {
-				getWorld()->playSound(SOUND_PLAYER_JUMP); // if so, we want to increment our jumpBoost
+			collided = getWorld()->findOverlap(x, y - SPRITE_HEIGHT / 2, KIND_COLLIDABLE); // check if there is floor below her
+			if (collided != nullptr) {
+				getWorld()->postSound(SOUND_PLAYER_JUMP); // if so, we want to increment our jumpBoost
 				jumping = true;
 				if (jumpBoost > 0)
 					jumpDistance = 12;
@@ -70,16 +158,19 @@ void Peach::doSomething() {
 			break;
 		case (KEY_PRESS_SPACE):
 			if (shootBoost && shootCooldown == 0) { // if peach has a flower and has no shoot cooldown, then shoot a fireball
-				getWorld()->playSound(SOUND_PLAYER_FIRE);
+				getWorld()->postSound(SOUND_PLAYER_FIRE);
 				shootCooldown = 8;
-				getWorld()->CreateFireball(true, getX() + ((1 - getDirection() / 90) * SPRITE_HEIGHT / 2), getY(), getDirection());
+				getWorld()->CreateFireball(true, x + ((1 - getDirection() / 90) * SPRITE_HEIGHT / 2), y, getDirection());
 			}
 			break;
 		}
 	}
 
-	if (!jumping && collided != nullptr && collided->isCollidable()) // if we bumped into any collidable, then bonk it
-		collided->bonk();
+	if (x != getX() || y != getY())
+		moveTo(x, y);
+
+	if (!jumping && collided != nullptr) // if we bumped into any collidable, then bonk it
+		getWorld()->postBonk(collided);
 }
 
 void Peach::bonk() {
@@ -91,7 +182,7 @@ void Peach::bonk() {
 	shootBoost = false;
 	jumpBoost = false;
 	if (m_hitpoints > 0) {
-		getWorld()->playSound(SOUND_PLAYER_HURT);
+		getWorld()->postSound(SOUND_PLAYER_HURT);
 	}
 	else {
 		setAlive(false);
@@ -119,9 +210,9 @@ void Peach::powerup(int powerup) {
 void Collidable::bonk() {
 	// if the block holds a goodie, drop it. otherwise, just make the bonk noise
 	if (!dropGoodie())
-		getWorld()->playSound(SOUND_PLAYER_BONK);
+		getWorld()->postSound(SOUND_PLAYER_BONK);
 	else
-		getWorld()->playSound(SOUND_POWERUP_APPEARS);
+		getWorld()->postSound(SOUND_POWERUP_APPEARS);
 }
 
 bool Block::dropGoodie() {
@@ -136,7 +227,7 @@ bool Block::dropGoodie() {
 // Enemy Methods
 void Enemy::bonk() {
 	setAlive(false);
-	getWorld()->increaseScore(100); // increment score and kill itself
+	getWorld()->postScore(100); // increment score and kill itself
 	die(); // call our private die() method
 }
 
@@ -146,9 +237,9 @@ void Enemy::doSomething() {
 
 	move1();
 
-	Actor* peach = getWorld()->isBlockingObject(getX(), getY(), true, false);
-	if (peach != nullptr && getWorld()->isPeach(peach)) { // check if peach overlaps. if she does, then we want to bonk her
-		peach->bonk();
+	Actor* peach = getWorld()->findOverlap(getX(), getY(), KIND_PEACH);
+	if (peach != nullptr) { // check if peach overlaps. if she does, then we want to bonk her
+		getWorld()->postBonk(peach);
 		return;
 	}
 
@@ -169,8 +260,8 @@ void Enemy::move2() {
 	// when it is going right. pretty much, cx = dx when facing left and cx = dx + 1 when facing right
 	if (dir == 0) // if we are facing right, then add 1 to cx
 		cx++;
-	Actor* collided = getWorld()->isBlockingObject(getX() + cx, getY());
-	Actor* floor = getWorld()->isBlockingObject(getX() + (dx * (SPRITE_WIDTH - 1)) + cx, getY() - 1);
+	Actor* collided = getWorld()->findOverlap(getX() + cx, getY(), KIND_COLLIDABLE);
+	Actor* floor = getWorld()->findOverlap(getX() + (dx * (SPRITE_WIDTH - 1)) + cx, getY() - 1, KIND_COLLIDABLE);
 	if (collided != nullptr || floor == nullptr) // if there is a blocking object or no floor in front, we swap directions
 		setDirection((dir + 180) % 360);
 
@@ -180,7 +271,7 @@ void Enemy::move2() {
 	cx = dx;
 	if (dir == 0) // if we are facing right, then add 1 to cx
 		cx++;
-	collided = getWorld()->isBlockingObject(getX() + cx, getY());
+	collided = getWorld()->findOverlap(getX() + cx, getY(), KIND_COLLIDABLE);
 	if (collided != nullptr) // similar to the sample, we only check for a blocking object (meaning we can still move forward for 1 frame without a floor)
 		return;
 	moveTo(getX() + dx, getY()); // move our enemy
@@ -209,7 +300,7 @@ void Piranha::move2() {
 	}
 
 	if (abs(getX() - getWorld()->getPeach()->getX()) < 8 * SPRITE_WIDTH) { // if peach is close enough, shoot and reset our firing cooldown
-		getWorld()->playSound(SOUND_PIRANHA_FIRE);
+		getWorld()->postSound(SOUND_PIRANHA_FIRE);
 		getWorld()->CreateFireball(false, getX(), getY(), getDirection());
 		firingDelay = 40;
 	}
@@ -220,33 +311,30 @@ void Koopa::die() {
 }
 
 // Projectile Methods
+
 void Projectile::doSomething() {
 	if (!isAlive()) { // if we are dead, dont do anything
 		return;
 	}
-	Actor* overlap = getWorld()->isBlockingObject(getX(), getY(), targetsPeach, false);
 	// we want to see if we are currently overlapping a valid target
-	if (overlap != nullptr && overlap->isAlive() && ((targetsPeach && getWorld()->isPeach(overlap)) || (!targetsPeach && overlap->isDamageable()))) {
+	Actor* overlap = getWorld()->findOverlap(getX(), getY(), targetsPeach ? KIND_PEACH : KIND_DAMAGEABLE);
+	if (overlap != nullptr) {
 		interact(overlap); // interact based on whatever projectile we are
 		setAlive(false); // disappear
 		return;
 	}
 
-	// check 2 pixels below
+	// fall 2 pixels (or until we land), then go 2 pixels forward from there. we only actually move once at the end
+	int newX = getX();
 	int newY = getY();
-	Actor* below = getWorld()->isBlockingObject(getX(), getY() - SPRITE_HEIGHT / 4);
-	if (below == nullptr || !below->isCollidable())  // if there is no ground below, we want to move down
-		newY = getY() - SPRITE_HEIGHT / 4;
-
-	// check 2 pixels forward (assume that we moved down, but we have not actually yet)
+	getWorld()->sweep(newX, newY, 0, -SPRITE_HEIGHT / 4, KIND_COLLIDABLE);
 	int dir = getDirection();
-	int newX = getX() + ((1 - dir / 90) * SPRITE_HEIGHT / 4);
-	Actor* collided = getWorld()->isBlockingObject(newX, newY);
+	Actor* collided = getWorld()->sweep(newX, newY, (1 - dir / 90) * SPRITE_HEIGHT / 4, 0, KIND_COLLIDABLE);
 
 	// see if we collided with anything
 	if (collided != nullptr)
 		if (bounces) { // if we did and we bounce, then we flip
-			moveTo(getX(), newY); // i added this just to mimic the sample code, as it seems to still move one before it bounces
+			moveTo(newX, newY); // i added this just to mimic the sample code, as it seems to still move one before it bounces
 			setDirection((dir + 180) % 360);
 		}
 		else // if we dont bounce, disappear
@@ -255,14 +343,18 @@ void Projectile::doSomething() {
 		moveTo(newX, newY);
 }
 
+void Projectile::interact(Actor* actor) {
+	getWorld()->postBonk(actor); // simply bonks an enemy it overlaps with by default
+}
+
 void Mushroom::interact(Actor* actor) {
 	// return if we are not peach
 	if (actor != getWorld()->getPeach())
 		return;
 	// increment points accordingly, playing the sound, and give peach the jump powerup
-	getWorld()->increaseScore(75);
-	getWorld()->getPeach()->powerup(1);
-	getWorld()->playSound(SOUND_PLAYER_POWERUP);
+	getWorld()->postScore(75);
+	getWorld()->postPowerup(1);
+	getWorld()->postSound(SOUND_PLAYER_POWERUP);
 }
 
 void Flower::interact(Actor* actor) {
@@ -270,9 +362,9 @@ void Flower::interact(Actor* actor) {
 	if (actor != getWorld()->getPeach())
 		return;
 	// increment points accordingly, playing the sound, and give peach the shoot powerup
-	getWorld()->increaseScore(50);
-	getWorld()->getPeach()->powerup(2);
-	getWorld()->playSound(SOUND_PLAYER_POWERUP);
+	getWorld()->postScore(50);
+	getWorld()->postPowerup(2);
+	getWorld()->postSound(SOUND_PLAYER_POWERUP);
 }
 
 void Star::interact(Actor* actor) {
@@ -280,16 +372,16 @@ void Star::interact(Actor* actor) {
 	if (actor != getWorld()->getPeach())
 		return;
 	// increment points accordingly, playing the sound, and give peach the star powerup
-	getWorld()->increaseScore(100);
-	getWorld()->getPeach()->powerup(3);
-	getWorld()->playSound(SOUND_PLAYER_POWERUP);
+	getWorld()->postScore(100);
+	getWorld()->postPowerup(3);
+	getWorld()->postSound(SOUND_PLAYER_POWERUP);
 }
 
 void PiranhaFireball::interact(Actor* actor) {
 	// return if we are not peach
 	if (actor != getWorld()->getPeach())
 		return;
-	getWorld()->getPeach()->bonk(); // bonk peach
+	getWorld()->postBonk(getWorld()->getPeach()); // bonk peach
 }
 
 // LevelEnder methods
@@ -298,9 +390,9 @@ void LevelEnder::doSomething() {
 	if (!isAlive()) // dont do anything if we are dead
 		return;
 
-	Actor* peach = getWorld()->isBlockingObject(getX(), getY(), true, false);
-	if (peach != nullptr && getWorld()->isPeach(peach)) { // if we overlap with peach
-		getWorld()->increaseScore(1000); // increase our score
+	Actor* peach = getWorld()->findOverlap(getX(), getY(), KIND_PEACH);
+	if (peach != nullptr) { // if we overlap with peach
+		getWorld()->postScore(1000); // increase our score
 		setAlive(false);
 		progress();
 	}
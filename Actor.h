@@ -3,26 +3,60 @@
 
 #include "GraphObject.h"
 #include <iostream> // for debugging purposes
+#include <vector>
 using namespace std;
 
 // Students:  Add code to this file, Actor.cpp, StudentWorld.h, and StudentWorld.cpp
 
 class StudentWorld;
 
+// what kind of actor something is, as far as collision queries care (see StudentWorld::findOverlap). these are bits, so
+// a query can ask for several kinds at once
+enum ActorKind {
+	KIND_COLLIDABLE = 1, // blocks and pipes
+	KIND_DAMAGEABLE = 2, // enemies
+	KIND_PEACH = 4,
+	KIND_PICKUP = 8, // goodies peach can pick up
+	KIND_OTHER = 16, // everything else (fireballs, shells, flags, mario)
+	KIND_ANY = 31
+};
+
 class Actor : public GraphObject {
 public:
-	Actor(StudentWorld* world, int imageID, int startX, int startY, int startDirection = 0, int depth = 0, double size = 1.0) :
-		GraphObject(imageID, startX, startY, startDirection, depth, size), m_alive(true), m_world(world) {}
-	StudentWorld* getWorld() { return m_world; }
-	void setAlive(bool status) { m_alive = status; }
+	Actor(StudentWorld* world, int imageID, int startX, int startY, int startDirection = 0, int depth = 0, double size = 1.0);
+	StudentWorld* getWorld() { return worlds()[m_world]; }
+	void setAlive(bool status); // also lets our world know when we die so it can clean us up
 	bool isAlive() { return m_alive; }
+	virtual void moveTo(int x, int y); // also keeps our world's spatial index up to date
+	unsigned int getSpawnOrder() const { return m_spawnOrder; }
+	void setSpawnOrder(unsigned int order) { m_spawnOrder = order; }
 	virtual bool isCollidable() { return false; } // every actor is not collidable by default
 	virtual bool isDamageable() { return false; } // any actor is not damageable by default
+	virtual int getKind() { return isCollidable() ? KIND_COLLIDABLE : isDamageable() ? KIND_DAMAGEABLE : KIND_OTHER; }
 	virtual void doSomething() = 0; // every actor should do something every tick
 	virtual void bonk() = 0; // every actor should do something like make noise when bonk()'ed
+
+	// actors don't keep a pointer to their world (that's 8 bytes on every one of them), just a slot in this table.
+	// every world takes a slot when it's made and gives it back when it's destroyed, which has to happen while no
+	// world is updating. registerWorld returns -1 if there are already MAX_WORLDS worlds
+	static const int MAX_WORLDS = 32767;
+	static int registerWorld(StudentWorld* world);
+	static void unregisterWorld(int slot);
+
+	// actors come and go all the time (fireballs, goodies, every chunk that streams in or out, every restart), so their
+	// memory goes onto a free list when they're deleted and gets handed to the next one of the same size instead of
+	// going back to the heap (see Actor.cpp)
+	static void* operator new(size_t size);
+	static void operator delete(void* p, size_t size);
 private:
-	StudentWorld* m_world;
-	bool m_alive;
+	static std::vector<StudentWorld*>& worlds() {
+		static std::vector<StudentWorld*> table;
+		return table;
+	}
+	// these fit into the end of GraphObject, so a plain actor is only as big as its GraphObject
+	unsigned short m_world : 15; // slot in worlds()
+	unsigned short m_alive : 1;
+	unsigned int m_spawnOrder; // position in the world's actor list, used to keep collision results in list order
 };
 
 class Peach : public Actor {
@@ -32,6 +66,7 @@ public:
 		m_hitpoints(1), invincibleBoost(0), jumpBoost(false), shootBoost(false), starBoost(0), jumpDistance(0), shootCooldown(0) {}
 	virtual void doSomething();
 	virtual void bonk();
+	virtual int getKind() { return KIND_PEACH; }
 	void powerup(int powerup);
 	bool hasJumpBoost() { return jumpBoost; }
 	bool hasShootBoost() { return shootBoost; }
@@ -45,10 +80,11 @@ public:
 	// (though she is still damageable).
 
 private:
-	int m_hitpoints;
+	// all of these are small (star power is the longest at 150 ticks), so a byte each is plenty
+	unsigned char m_hitpoints;
 	bool jumpBoost, shootBoost; // powerup toggles
-	int invincibleBoost, starBoost; // power-up durations
-	int jumpDistance, shootCooldown; // power-up/movement values
+	unsigned char invincibleBoost, starBoost; // power-up durations
+	unsigned char jumpDistance, shootCooldown; // power-up/movement values
 };
 
 // Collidable container class (pipe, block)
@@ -68,8 +104,9 @@ class Block : public Collidable {
 public:
 	Block(StudentWorld* world, int imageID, int startX, int startY, int startDirection = 0, int depth = 2, double size = 1.0, int goodie = 0) :
 		Collidable(world, imageID, startX, startY, startDirection, depth, size), m_goodie(goodie) {}
+	bool hasGoodie() const { return m_goodie != 0; }
 private:
-	int m_goodie; // denotes what goodie a block has, if any
+	unsigned char m_goodie; // denotes what goodie a block has, if any
 	virtual bool dropGoodie(); // drops the goodie it stores, if it has one
 };
 
@@ -107,7 +144,7 @@ public:
 private:
 	virtual void move1() { increaseAnimationNumber(); } // simply animates itself every frame
 	virtual void move2();
-	int firingDelay;
+	unsigned char firingDelay;
 };
 
 class Koopa : public Enemy {
@@ -131,29 +168,38 @@ public:
 private:
 	bool bounces; // change directions if it hits a collidable
 	bool targetsPeach; // whether or not it interacts with peach
-	virtual void interact(Actor* actor) { actor->bonk(); } // simply bonks an enemy it overlaps with by default
+	virtual void interact(Actor* actor); // simply bonks an enemy it overlaps with by default
 };
 
-class Mushroom : public Projectile {
+// Goodie container class (mushroom, flower, star)
+
+class Goodie : public Projectile {
 public:
-	Mushroom(StudentWorld* world, int imageID, int startX, int startY, int startDirection = 0, int depth = 1, double size = 1.0) :
+	Goodie(StudentWorld* world, int imageID, int startX, int startY, int startDirection = 0, int depth = 1, double size = 1.0) :
 		Projectile(world, imageID, startX, startY, startDirection, depth, size) {}
+	virtual int getKind() { return KIND_PICKUP; }
+};
+
+class Mushroom : public Goodie {
+public:
+	Mushroom(StudentWorld* world, int imageID, int startX, int startY, int startDirection = 0, int depth = 1, double size = 1.0) :
+		Goodie(world, imageID, startX, startY, startDirection, depth, size) {}
 private:
 	virtual void interact(Actor* actor);
 };
 
-class Flower : public Projectile {
+class Flower : public Goodie {
 public:
 	Flower(StudentWorld* world, int imageID, int startX, int startY, int startDirection = 0, int depth = 1, double size = 1.0) :
-		Projectile(world, imageID, startX, startY, startDirection, depth, size) {}
+		Goodie(world, imageID, startX, startY, startDirection, depth, size) {}
 private:
 	virtual void interact(Actor* actor);
 };
 
-class Star : public Projectile {
+class Star : public Goodie {
 public:
 	Star(StudentWorld* world, int imageID, int startX, int startY, int startDirection = 0, int depth = 1, double size = 1.0) :
-		Projectile(world, imageID, startX, startY, startDirection, depth, size) {}
+		Goodie(world, imageID, startX, startY, startDirection, depth, size) {}
 private:
 	virtual void interact(Actor* actor);
 };
@@ -0,0 +1,80 @@
+#include "AllocStats.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+using namespace std;
+
+static const char* const phaseNames[AllocStats::NUM_PHASES] = {
+	"other", "level", "stream", "peach", "actors", "events", "status", "render", "observe"
+};
+
+const char* AllocStats::phaseName(int phase) {
+	return phase >= 0 && phase < NUM_PHASES ? phaseNames[phase] : "unknown";
+}
+
+#ifdef SPS_COUNT_ALLOCS
+
+// plain zero-initialized statics, so they already work for allocations made before main()
+static atomic<unsigned long long> allocCounts[AllocStats::NUM_PHASES];
+static atomic<unsigned long long> allocBytes[AllocStats::NUM_PHASES];
+
+thread_local AllocStats::Phase AllocStats::t_phase = AllocStats::other;
+
+bool AllocStats::enabled() {
+	return true;
+}
+
+void AllocStats::record(size_t bytes) {
+	allocCounts[t_phase].fetch_add(1, memory_order_relaxed);
+	allocBytes[t_phase].fetch_add(bytes, memory_order_relaxed);
+}
+
+void AllocStats::read(Counts& counts) {
+	for (int p = 0; p < NUM_PHASES; p++) {
+		counts.allocs[p] = allocCounts[p].load(memory_order_relaxed);
+		counts.bytes[p] = allocBytes[p].load(memory_order_relaxed);
+	}
+}
+
+// every allocation in the program comes through here (the array and nothrow forms end up here too). over-aligned
+// allocations go to the library's own aligned operator new and aren't counted, but nothing in the game makes any
+void* operator new(size_t size) {
+	AllocStats::record(size);
+	void* p = malloc(size > 0 ? size : 1);
+	if (p == nullptr)
+		throw bad_alloc();
+	return p;
+}
+
+void* operator new[](size_t size) {
+	return operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+	free(p);
+}
+
+void operator delete[](void* p) noexcept {
+	free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+	free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+	free(p);
+}
+
+#else
+
+bool AllocStats::enabled() {
+	return false;
+}
+
+void AllocStats::read(Counts& counts) {
+	for (int p = 0; p < NUM_PHASES; p++)
+		counts.allocs[p] = counts.bytes[p] = 0;
+}
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef ALLOCSTATS_H_
+#define ALLOCSTATS_H_
+
+#include <cstddef>
+
+// Counts heap allocations by which part of a tick they happen in. Counting means replacing the global operator new,
+// so it's only built in when SPS_COUNT_ALLOCS is defined (the benchmark defines it). Without it nothing gets counted
+// and a Scope compiles down to nothing, so the phases can stay marked in the game itself.
+
+class AllocStats {
+public:
+	enum Phase {
+		other,  // anything not marked below
+		level,  // loading and unloading a level
+		stream, // streaming chunks in and out
+		peach,  // peach's update
+		actors, // everyone else's update, on whichever thread it runs
+		events, // handing out what the tick's events did and deleting the dead
+		status, // camera and status text
+		render, // drawing a frame
+		observe, // drawing an observation for an agent (StudentWorld::observeGrid/observeRGB)
+		NUM_PHASES
+	};
+
+	struct Counts {
+		unsigned long long allocs[NUM_PHASES];
+		unsigned long long bytes[NUM_PHASES];
+	};
+
+	// everything allocated on this thread while a Scope is alive counts towards its phase. set() switches phases
+	// partway through, and the phase from before the Scope comes back when it goes away
+	class Scope {
+	public:
+#ifdef SPS_COUNT_ALLOCS
+		explicit Scope(Phase phase) : m_previous(t_phase) { t_phase = phase; }
+		~Scope() { t_phase = m_previous; }
+		void set(Phase phase) { t_phase = phase; }
+	private:
+		Phase m_previous;
+#else
+		explicit Scope(Phase) {}
+		void set(Phase) {}
+#endif
+		Scope(const Scope&);
+		Scope& operator=(const Scope&);
+	};
+
+	static bool enabled(); // whether counting was built in
+	static void read(Counts& counts); // totals since the program started, all zero if counting isn't built in
+	static const char* phaseName(int phase);
+
+#ifdef SPS_COUNT_ALLOCS
+	static void record(std::size_t bytes); // for operator new
+private:
+	static thread_local Phase t_phase;
+#endif
+};
+
+#endif // ALLOCSTATS_H_
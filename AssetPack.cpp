@@ -0,0 +1,198 @@
+#include "AssetPack.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+using namespace std;
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static const char PACK_MAGIC[8] = { 'S', 'P', 'S', 'P', 'A', 'C', 'K', '\0' };
+
+AssetPack::AssetPack()
+ : m_data(nullptr), m_size(0), m_entries(nullptr), m_count(0)
+#if defined(_WIN32)
+   , m_file(INVALID_HANDLE_VALUE), m_mapping(nullptr)
+#endif
+{
+}
+
+AssetPack::~AssetPack()
+{
+	close();
+}
+
+bool AssetPack::open(const string& path)
+{
+	close();
+
+#if defined(_WIN32)
+	m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (m_file == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(m_file, &fileSize)  ||  fileSize.QuadPart == 0)
+	{
+		close();
+		return false;
+	}
+	m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (m_mapping == nullptr)
+	{
+		close();
+		return false;
+	}
+	m_data = static_cast<const char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+	m_size = static_cast<size_t>(fileSize.QuadPart);
+#else
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat statbuf;
+	if (fstat(fd, &statbuf) != 0  ||  statbuf.st_size == 0)
+	{
+		::close(fd);
+		return false;
+	}
+	void* mapping = mmap(nullptr, statbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);  // the mapping keeps the file alive
+	if (mapping != MAP_FAILED)
+	{
+		m_data = static_cast<const char*>(mapping);
+		m_size = static_cast<size_t>(statbuf.st_size);
+	}
+#endif
+	if (m_data == nullptr)
+	{
+		close();
+		return false;
+	}
+
+	  // check the header and make sure every entry actually lies inside the file
+
+	Header header;
+	if (m_size < sizeof(header))
+	{
+		close();
+		return false;
+	}
+	memcpy(&header, m_data, sizeof(header));
+	if (memcmp(header.magic, PACK_MAGIC, sizeof(PACK_MAGIC)) != 0  ||  header.version != VERSION  ||
+			header.count > (m_size - sizeof(header)) / sizeof(Entry))
+	{
+		close();
+		return false;
+	}
+	m_entries = reinterpret_cast<const Entry*>(m_data + sizeof(header));
+	m_count = header.count;
+	for (uint32_t i = 0; i < m_count; i++)
+	{
+		const Entry& e = m_entries[i];
+		if (e.name[MAX_NAME_LENGTH] != '\0'  ||  e.offset > m_size  ||  e.size > m_size - e.offset)
+		{
+			close();
+			return false;
+		}
+	}
+	return true;
+}
+
+void AssetPack::close()
+{
+#if defined(_WIN32)
+	if (m_data != nullptr)
+		UnmapViewOfFile(m_data);
+	if (m_mapping != nullptr)
+		CloseHandle(m_mapping);
+	if (m_file != INVALID_HANDLE_VALUE)
+		CloseHandle(m_file);
+	m_mapping = nullptr;
+	m_file = INVALID_HANDLE_VALUE;
+#else
+	if (m_data != nullptr)
+		munmap(const_cast<char*>(m_data), m_size);
+#endif
+	m_data = nullptr;
+	m_size = 0;
+	m_entries = nullptr;
+	m_count = 0;
+}
+
+bool AssetPack::find(const string& name, const char*& data, size_t& size) const
+{
+	  // the index is sorted by name, so binary search it
+	const Entry* first = m_entries;
+	const Entry* last = m_entries + m_count;
+	const Entry* e = lower_bound(first, last, name, [](const Entry& entry, const string& n) {
+		return strcmp(entry.name, n.c_str()) < 0;
+	});
+	if (e == last  ||  name != e->name)
+		return false;
+	data = m_data + e->offset;
+	size = static_cast<size_t>(e->size);
+	return true;
+}
+
+bool AssetPack::write(const string& path, const string& dir, vector<string> names)
+{
+	sort(names.begin(), names.end());
+	names.erase(unique(names.begin(), names.end()), names.end());
+
+	string prefix = dir;
+	if (!prefix.empty()  &&  prefix.back() != '/'  &&  prefix.back() != '\\')
+		prefix += '/';
+
+	  // read everything in first so we know where each blob lands
+
+	vector<string> contents(names.size());
+	for (size_t i = 0; i < names.size(); i++)
+	{
+		if (names[i].size() > static_cast<size_t>(MAX_NAME_LENGTH))
+			return false;
+		ifstream in(prefix + names[i], ios::in | ios::binary);
+		if (!in)
+			return false;
+		contents[i].assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+	}
+
+	Header header;
+	memcpy(header.magic, PACK_MAGIC, sizeof(PACK_MAGIC));
+	header.version = VERSION;
+	header.count = static_cast<uint32_t>(names.size());
+
+	vector<Entry> entries(names.size());
+	uint64_t offset = sizeof(header) + entries.size() * sizeof(Entry);
+	for (size_t i = 0; i < names.size(); i++)
+	{
+		offset = (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+		memset(entries[i].name, 0, sizeof(entries[i].name));
+		memcpy(entries[i].name, names[i].c_str(), names[i].size());
+		entries[i].offset = offset;
+		entries[i].size = contents[i].size();
+		offset += contents[i].size();
+	}
+
+	ofstream out(path, ios::out | ios::binary | ios::trunc);
+	if (!out)
+		return false;
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	if (!entries.empty())
+		out.write(reinterpret_cast<const char*>(&entries[0]), entries.size() * sizeof(Entry));
+	uint64_t written = sizeof(header) + entries.size() * sizeof(Entry);
+	for (size_t i = 0; i < names.size(); i++)
+	{
+		static const char padding[ALIGNMENT] = {};
+		out.write(padding, static_cast<streamsize>(entries[i].offset - written));
+		out.write(contents[i].data(), static_cast<streamsize>(contents[i].size()));
+		written = entries[i].offset + contents[i].size();
+	}
+	return static_cast<bool>(out);
+}
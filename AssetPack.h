@@ -0,0 +1,75 @@
+#ifndef ASSETPACK_H_
+#define ASSETPACK_H_
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+  // A single file holding every sprite and sound, so startup only has to open and map one file
+  // instead of one per asset.  The layout is a header, then an index of entries sorted by name,
+  // then the raw file contents, each starting on an ALIGNMENT byte boundary:
+  //
+  //   Header | Entry[count] | blob | padding | blob | ...
+  //
+  // Everything is little-endian.  Build one with the AssetPacker tool.
+
+const char* const ASSET_PACK_NAME = "assets.pak";
+
+class AssetPack
+{
+public:
+	static const std::size_t ALIGNMENT = 16;
+	static const int MAX_NAME_LENGTH = 47;
+
+	AssetPack();
+	~AssetPack();
+
+	  // maps the whole pack into memory; returns false if it is missing or malformed
+	bool open(const std::string& path);
+	void close();
+
+	bool isOpen() const
+	{
+		return m_data != nullptr;
+	}
+
+	  // points data at the contents of the named asset inside the mapping, which stays valid
+	  // until the pack is closed
+	bool find(const std::string& name, const char*& data, std::size_t& size) const;
+
+	  // writes a pack holding the given files from directory dir
+	static bool write(const std::string& path, const std::string& dir, std::vector<std::string> names);
+
+private:
+	struct Header
+	{
+		char		  magic[8];
+		std::uint32_t version;
+		std::uint32_t count;
+	};
+
+	struct Entry
+	{
+		char		  name[MAX_NAME_LENGTH + 1];
+		std::uint64_t offset;  // from the start of the file
+		std::uint64_t size;
+	};
+
+	static const std::uint32_t VERSION = 1;
+
+	const char*		m_data;
+	std::size_t		m_size;
+	const Entry*	m_entries;
+	std::uint32_t	m_count;
+#if defined(_WIN32)
+	void*			m_file;
+	void*			m_mapping;
+#endif
+
+	  // Prevent copying or assigning AssetPacks
+	AssetPack(const AssetPack&);
+	AssetPack& operator=(const AssetPack&);
+};
+
+#endif // ASSETPACK_H_
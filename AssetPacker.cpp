@@ -0,0 +1,72 @@
+// Builds the asset pack the game maps at startup out of every .tga and .wav file in a directory.
+//
+//   AssetPacker [assetDirectory [outputFile]]
+//
+// By default it packs Assets/ into Assets/assets.pak.
+
+#include "AssetPack.h"
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+#ifdef _WIN32
+#include <windows.h>
+static bool listFiles(string dir, vector<string>& names)
+{
+	WIN32_FIND_DATAA data;
+	HANDLE h = FindFirstFileA((dir + "/*").c_str(), &data);
+	if (h == INVALID_HANDLE_VALUE)
+		return false;
+	do
+	{
+		if (!(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+			names.push_back(data.cFileName);
+	} while (FindNextFileA(h, &data));
+	FindClose(h);
+	return true;
+}
+#else
+#include <dirent.h>
+static bool listFiles(string dir, vector<string>& names)
+{
+	DIR* d = opendir(dir.c_str());
+	if (d == nullptr)
+		return false;
+	for (dirent* entry = readdir(d); entry != nullptr; entry = readdir(d))
+		names.push_back(entry->d_name);
+	closedir(d);
+	return true;
+}
+#endif
+
+static bool endsWith(const string& s, const string& suffix)
+{
+	return s.size() >= suffix.size()  &&  s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+int main(int argc, char* argv[])
+{
+	string dir = (argc > 1 ? argv[1] : "Assets");
+	string output = (argc > 2 ? argv[2] : dir + "/" + ASSET_PACK_NAME);
+
+	vector<string> files;
+	if (!listFiles(dir, files))
+	{
+		cerr << "Cannot read directory " << dir << endl;
+		return 1;
+	}
+
+	vector<string> names;
+	for (size_t i = 0; i < files.size(); i++)
+		if (endsWith(files[i], ".tga")  ||  endsWith(files[i], ".wav"))
+			names.push_back(files[i]);
+
+	if (!AssetPack::write(output, dir, names))
+	{
+		cerr << "Cannot write asset pack " << output << endl;
+		return 1;
+	}
+	cout << "Packed " << names.size() << " assets into " << output << endl;
+	return 0;
+}
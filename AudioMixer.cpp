@@ -0,0 +1,441 @@
+#include "AudioMixer.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+using namespace std;
+
+#if defined(__linux__)
+#include <dlfcn.h>
+#endif
+
+static uint32_t readLE(const char* p, int bytes)
+{
+	uint32_t value = 0;
+	for (int i = bytes - 1; i >= 0; i--)
+		value = (value << 8) | static_cast<unsigned char>(p[i]);
+	return value;
+}
+
+static void writeLE(ostream& out, uint32_t value, int bytes)
+{
+	for (int i = 0; i < bytes; i++)
+		out.put(static_cast<char>((value >> (8 * i)) & 0xff));
+}
+
+  //========================================================================
+  // Sinks
+  //========================================================================
+
+  // Sinks that aren't real hardware sleep for as long as the samples would take to play, so
+  // the mixer runs at the same speed it would with a sound card.
+
+class ClockedSink : public AudioSink
+{
+public:
+	ClockedSink()
+	 : m_next(chrono::steady_clock::now())
+	{
+	}
+
+protected:
+	void waitForDevice(size_t count)
+	{
+		m_next += chrono::microseconds(static_cast<long long>(count) * 1000000 / AudioMixer::SAMPLE_RATE);
+		this_thread::sleep_until(m_next);
+	}
+
+private:
+	chrono::steady_clock::time_point m_next;
+};
+
+class NullSink : public ClockedSink
+{
+public:
+	virtual bool write(const short*, size_t count)
+	{
+		waitForDevice(count);
+		return true;
+	}
+};
+
+class FileSink : public ClockedSink
+{
+public:
+	FileSink(string path)
+	 : m_out(path, ios::out | ios::binary | ios::trunc), m_samples(0)
+	{
+		writeHeader();  // sizes get filled in when we're done
+	}
+
+	~FileSink()
+	{
+		m_out.seekp(0);
+		writeHeader();
+	}
+
+	bool isOpen() const
+	{
+		return static_cast<bool>(m_out);
+	}
+
+	virtual bool write(const short* samples, size_t count)
+	{
+		for (size_t i = 0; i < count; i++)
+			writeLE(m_out, static_cast<uint16_t>(samples[i]), 2);
+		m_samples += static_cast<uint32_t>(count);
+		waitForDevice(count);
+		return static_cast<bool>(m_out);
+	}
+
+private:
+	ofstream m_out;
+	uint32_t m_samples;
+
+	void writeHeader()
+	{
+		uint32_t dataBytes = m_samples * 2;
+		m_out.write("RIFF", 4);
+		writeLE(m_out, 36 + dataBytes, 4);
+		m_out.write("WAVEfmt ", 8);
+		writeLE(m_out, 16, 4);
+		writeLE(m_out, 1, 2);  // PCM
+		writeLE(m_out, 1, 2);  // mono
+		writeLE(m_out, AudioMixer::SAMPLE_RATE, 4);
+		writeLE(m_out, AudioMixer::SAMPLE_RATE * 2, 4);
+		writeLE(m_out, 2, 2);
+		writeLE(m_out, 16, 2);
+		m_out.write("data", 4);
+		writeLE(m_out, dataBytes, 4);
+	}
+};
+
+#if defined(__linux__)
+
+  // ALSA is loaded at run time so the game still builds and runs (silently) on machines
+  // without libasound.
+
+class AlsaSink : public AudioSink
+{
+public:
+	AlsaSink()
+	 : m_lib(nullptr), m_pcm(nullptr)
+	{
+		m_lib = dlopen("libasound.so.2", RTLD_NOW);
+		if (m_lib == nullptr)
+			return;
+		m_open = reinterpret_cast<OpenFunc>(dlsym(m_lib, "snd_pcm_open"));
+		m_setParams = reinterpret_cast<SetParamsFunc>(dlsym(m_lib, "snd_pcm_set_params"));
+		m_writei = reinterpret_cast<WriteiFunc>(dlsym(m_lib, "snd_pcm_writei"));
+		m_recover = reinterpret_cast<RecoverFunc>(dlsym(m_lib, "snd_pcm_recover"));
+		m_close = reinterpret_cast<CloseFunc>(dlsym(m_lib, "snd_pcm_close"));
+		if (m_open == nullptr  ||  m_setParams == nullptr  ||  m_writei == nullptr  ||  m_recover == nullptr  ||  m_close == nullptr)
+			return;
+		if (m_open(&m_pcm, "default", SND_PCM_STREAM_PLAYBACK, 0) < 0)
+		{
+			m_pcm = nullptr;
+			return;
+		}
+		  // let ALSA resample if the device doesn't do our rate; aim for about 50 ms of latency
+		if (m_setParams(m_pcm, SND_PCM_FORMAT_S16_LE, SND_PCM_ACCESS_RW_INTERLEAVED, 1, AudioMixer::SAMPLE_RATE, 1, 50000) < 0)
+		{
+			m_close(m_pcm);
+			m_pcm = nullptr;
+		}
+	}
+
+	~AlsaSink()
+	{
+		if (m_pcm != nullptr)
+			m_close(m_pcm);
+		if (m_lib != nullptr)
+			dlclose(m_lib);
+	}
+
+	bool isOpen() const
+	{
+		return m_pcm != nullptr;
+	}
+
+	virtual bool write(const short* samples, size_t count)
+	{
+		while (count > 0)
+		{
+			long written = m_writei(m_pcm, samples, count);
+			if (written < 0)
+			{
+				  // most likely an underrun; try to get going again
+				if (m_recover(m_pcm, static_cast<int>(written), 1) < 0)
+					return false;
+				continue;
+			}
+			samples += written;
+			count -= written;
+		}
+		return true;
+	}
+
+private:
+	  // the handful of ALSA declarations we need, straight from <alsa/asoundlib.h>
+	struct snd_pcm_t;
+	enum { SND_PCM_STREAM_PLAYBACK = 0, SND_PCM_FORMAT_S16_LE = 2, SND_PCM_ACCESS_RW_INTERLEAVED = 3 };
+	typedef int (*OpenFunc)(snd_pcm_t**, const char*, int, int);
+	typedef int (*SetParamsFunc)(snd_pcm_t*, int, int, unsigned int, unsigned int, int, unsigned int);
+	typedef long (*WriteiFunc)(snd_pcm_t*, const void*, unsigned long);
+	typedef int (*RecoverFunc)(snd_pcm_t*, int, int);
+	typedef int (*CloseFunc)(snd_pcm_t*);
+
+	void*			m_lib;
+	snd_pcm_t*		m_pcm;
+	OpenFunc		m_open;
+	SetParamsFunc	m_setParams;
+	WriteiFunc		m_writei;
+	RecoverFunc		m_recover;
+	CloseFunc		m_close;
+};
+
+#endif
+
+AudioSink* createAudioSink()
+{
+	const char* setting = getenv("SPS_AUDIO_SINK");
+	string sink = (setting != nullptr ? setting : "alsa");
+
+	if (sink.compare(0, 5, "file:") == 0)
+	{
+		FileSink* file = new FileSink(sink.substr(5));
+		if (file->isOpen())
+			return file;
+		cerr << "Cannot write " << sink.substr(5) << "!  Game will be silent." << endl;
+		delete file;
+	}
+#if defined(__linux__)
+	else if (sink == "alsa")
+	{
+		AlsaSink* alsa = new AlsaSink;
+		if (alsa->isOpen())
+			return alsa;
+		cerr << "Cannot open ALSA device!  Game will be silent." << endl;
+		delete alsa;
+	}
+#endif
+	return new NullSink;
+}
+
+  //========================================================================
+  // AudioMixer
+  //========================================================================
+
+AudioMixer::AudioMixer(AudioSink* sink)
+ : m_sink(sink), m_numClips(0), m_maxVoices(DEFAULT_VOICES), m_queueHead(0), m_queueTail(0), m_quit(false)
+{
+	for (int k = 0; k < MAX_CLIPS; k++)
+		m_priorities[k] = 0;
+	const char* voices = getenv("SPS_AUDIO_VOICES");
+	if (voices != nullptr)
+		setMaxVoices(atoi(voices));
+	m_voices.reserve(MAX_VOICES);
+	m_thread = thread(&AudioMixer::run, this);
+}
+
+AudioMixer::~AudioMixer()
+{
+	m_quit = true;
+	m_thread.join();
+	delete m_sink;
+}
+
+bool AudioMixer::decodeWav(const char* data, size_t size, vector<short>& samples)
+{
+	if (size < 12  ||  memcmp(data, "RIFF", 4) != 0  ||  memcmp(data + 8, "WAVE", 4) != 0)
+		return false;
+
+	  // walk the chunks; we only care about "fmt " and "data" (some files have JUNK etc.)
+	uint32_t format = 0, channels = 0, rate = 0, bits = 0;
+	const char* pcm = nullptr;
+	size_t pcmBytes = 0;
+	for (size_t pos = 12; pos + 8 <= size; )
+	{
+		uint32_t chunkSize = readLE(data + pos + 4, 4);
+		const char* chunk = data + pos + 8;
+		size_t available = size - pos - 8;
+		if (memcmp(data + pos, "fmt ", 4) == 0  &&  chunkSize >= 16  &&  available >= 16)
+		{
+			format = readLE(chunk, 2);
+			channels = readLE(chunk + 2, 2);
+			rate = readLE(chunk + 4, 4);
+			bits = readLE(chunk + 14, 2);
+		}
+		else if (memcmp(data + pos, "data", 4) == 0)
+		{
+			pcm = chunk;
+			pcmBytes = min<size_t>(chunkSize, available);
+		}
+		pos += 8 + chunkSize + (chunkSize & 1);  // chunks are padded to an even size
+	}
+	if (format != 1  ||  channels < 1  ||  rate == 0  ||  (bits != 8  &&  bits != 16)  ||  pcm == nullptr)
+		return false;
+
+	  // mix down to mono and resample (linearly) to our rate
+	size_t bytesPerFrame = channels * bits / 8;
+	size_t frames = pcmBytes / bytesPerFrame;
+	vector<int> mono(frames);
+	for (size_t f = 0; f < frames; f++)
+	{
+		int sum = 0;
+		for (uint32_t c = 0; c < channels; c++)
+		{
+			const char* p = pcm + f * bytesPerFrame + c * bits / 8;
+			if (bits == 16)
+				sum += static_cast<int16_t>(readLE(p, 2));
+			else
+				sum += (static_cast<unsigned char>(*p) - 128) << 8;
+		}
+		mono[f] = sum / static_cast<int>(channels);
+	}
+
+	size_t outFrames = static_cast<size_t>(static_cast<uint64_t>(frames) * SAMPLE_RATE / rate);
+	samples.resize(outFrames);
+	for (size_t i = 0; i < outFrames; i++)
+	{
+		uint64_t fixed = static_cast<uint64_t>(i) * rate * 256 / SAMPLE_RATE;  // source position in 1/256ths
+		size_t f = static_cast<size_t>(fixed >> 8);
+		int frac = static_cast<int>(fixed & 255);
+		int a = mono[f];
+		int b = (f + 1 < frames ? mono[f + 1] : a);
+		samples[i] = static_cast<short>(a + (b - a) * frac / 256);
+	}
+	return true;
+}
+
+int AudioMixer::addClip(const vector<short>& samples)
+{
+	int n = m_numClips.load(memory_order_relaxed);
+	if (n == MAX_CLIPS)
+		return -1;
+	m_clips[n] = samples;
+	m_numClips.store(n + 1, memory_order_release);
+	return n;
+}
+
+void AudioMixer::setClipPriority(int clip, int priority)
+{
+	if (clip >= 0  &&  clip < MAX_CLIPS)
+		m_priorities[clip] = priority;
+}
+
+void AudioMixer::setMaxVoices(int voices)
+{
+	if (voices < 1)
+		voices = 1;
+	else if (voices > MAX_VOICES)
+		voices = MAX_VOICES;
+	m_maxVoices = voices;
+}
+
+void AudioMixer::play(int clip, unsigned int tick)
+{
+	if (clip < 0  ||  clip >= m_numClips.load(memory_order_relaxed)  ||  m_clips[clip].empty())
+		return;
+	Command cmd = { clip, tick };
+	push(cmd);
+}
+
+void AudioMixer::stopAll()
+{
+	Command cmd = { STOP_ALL, 0 };
+	push(cmd);
+}
+
+bool AudioMixer::push(const Command& cmd)
+{
+	unsigned int head = m_queueHead.load(memory_order_relaxed);
+	if (head - m_queueTail.load(memory_order_acquire) == QUEUE_SIZE)
+		return false;  // full; losing a sound beats stalling the game
+	m_queue[head & (QUEUE_SIZE - 1)] = cmd;
+	m_queueHead.store(head + 1, memory_order_release);
+	return true;
+}
+
+void AudioMixer::drainCommands()
+{
+	unsigned int tail = m_queueTail.load(memory_order_relaxed);
+	unsigned int head = m_queueHead.load(memory_order_acquire);
+	for ( ; tail != head; tail++)
+	{
+		const Command& cmd = m_queue[tail & (QUEUE_SIZE - 1)];
+		if (cmd.clip == STOP_ALL)
+			m_voices.clear();
+		else
+			startVoice(cmd);
+	}
+	m_queueTail.store(tail, memory_order_release);
+}
+
+void AudioMixer::startVoice(const Command& cmd)
+{
+	Voice v = { cmd.clip, 0, cmd.tick };
+	size_t limit = static_cast<size_t>(m_maxVoices.load(memory_order_relaxed));
+	while (m_voices.size() > limit)  // the limit was lowered since these started
+		m_voices.pop_back();
+	if (m_voices.size() < limit)
+	{
+		m_voices.push_back(v);
+		return;
+	}
+
+	  // every voice is busy; steal the least important one, if it isn't more important than us
+	int priority = m_priorities[cmd.clip];
+	size_t victim = m_voices.size();
+	for (size_t k = 0; k < m_voices.size(); k++)
+	{
+		int p = m_priorities[m_voices[k].clip];
+		if (p > priority)
+			continue;
+		if (victim == m_voices.size()  ||  p < m_priorities[m_voices[victim].clip]  ||
+			(p == m_priorities[m_voices[victim].clip]  &&  cmd.tick - m_voices[k].tick > cmd.tick - m_voices[victim].tick))
+			victim = k;
+	}
+	if (victim != m_voices.size())
+		m_voices[victim] = v;
+}
+
+void AudioMixer::run()
+{
+	int mix[PERIOD_FRAMES];
+	short out[PERIOD_FRAMES];
+	while (!m_quit)
+	{
+		memset(mix, 0, sizeof(mix));
+		drainCommands();
+		for (size_t v = 0; v < m_voices.size(); )
+		{
+			Voice& voice = m_voices[v];
+			const vector<short>& clip = m_clips[voice.clip];
+			size_t n = min<size_t>(PERIOD_FRAMES, clip.size() - voice.position);
+			const short* samples = clip.data() + voice.position;
+			for (size_t i = 0; i < n; i++)
+				mix[i] += samples[i];
+			voice.position += n;
+			if (voice.position >= clip.size())
+			{
+				  // finished; order doesn't matter, so swap it out
+				m_voices[v] = m_voices.back();
+				m_voices.pop_back();
+			}
+			else
+				v++;
+		}
+		for (int i = 0; i < PERIOD_FRAMES; i++)
+			out[i] = static_cast<short>(max(-32768, min(32767, mix[i])));
+		if (!m_sink->write(out, PERIOD_FRAMES))
+		{
+			  // the device went away; keep the clock running so the game doesn't notice
+			delete m_sink;
+			m_sink = new NullSink;
+		}
+	}
+}
@@ -0,0 +1,106 @@
+#ifndef AUDIOMIXER_H_
+#define AUDIOMIXER_H_
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <cstddef>
+
+  // Where the mixer sends its output.  write() blocks until the device (or the clock, for the
+  // sinks that aren't real hardware) is ready for more, which is what paces the audio thread.
+
+class AudioSink
+{
+public:
+	virtual ~AudioSink() {}
+	virtual bool write(const short* samples, std::size_t count) = 0;
+};
+
+  // Picks a sink based on the SPS_AUDIO_SINK environment variable:
+  //   "null"         discard everything
+  //   "file:<path>"  write everything that gets mixed to a WAV file
+  //   "alsa"         the default ALSA device (this is the default; falls back to null if ALSA
+  //                  isn't available)
+
+AudioSink* createAudioSink();
+
+  // Keeps every clip decoded in memory and mixes whatever is playing on its own thread.
+  // play() and stopAll() are meant to be called from the game thread: they only drop a small
+  // command into a fixed-size single-producer/single-consumer ring that the mixer drains at
+  // the start of every period, so they never lock and never allocate.  If the ring is full
+  // (the mixer is more than QUEUE_SIZE commands behind) the command is dropped.
+  //
+  // At most maxVoices clips play at once.  When a new clip starts with every voice busy it
+  // takes over the voice of the lowest-priority clip playing (the oldest one if there's a
+  // tie), as long as that clip's priority is no higher than its own; otherwise it isn't played.
+
+class AudioMixer
+{
+public:
+	static const int SAMPLE_RATE = 22050;  // mono, signed 16-bit
+	static const int PERIOD_FRAMES = 512;  // how much gets mixed at a time
+	static const int MAX_CLIPS = 64;
+	static const int MAX_VOICES = 32;     // upper limit for setMaxVoices
+	static const int DEFAULT_VOICES = 8;  // unless SPS_AUDIO_VOICES says otherwise
+	static const unsigned int QUEUE_SIZE = 256;  // must be a power of two
+
+	explicit AudioMixer(AudioSink* sink);  // takes ownership of the sink
+	~AudioMixer();
+
+	  // Decodes a PCM WAV file held in memory into mono samples at SAMPLE_RATE.
+	static bool decodeWav(const char* data, std::size_t size, std::vector<short>& samples);
+
+	  // Adds a decoded clip and returns the id to play it with, or -1 if there's no room.
+	  // Clips are added up front, from the same thread that calls play().
+	int addClip(const std::vector<short>& samples);
+
+	  // Higher priorities win when voices run out; clips start out at 0.  Set it before the
+	  // clip is first played.
+	void setClipPriority(int clip, int priority);
+
+	  // How many clips can play at once, between 1 and MAX_VOICES.
+	void setMaxVoices(int voices);
+
+	  // tick is the game tick the sound was asked for on
+	void play(int clip, unsigned int tick);
+	void stopAll();
+
+private:
+	struct Command
+	{
+		int				clip;  // STOP_ALL stops everything
+		unsigned int	tick;
+	};
+	static const int STOP_ALL = -1;
+
+	struct Voice
+	{
+		int				clip;
+		std::size_t		position;
+		unsigned int	tick;  // when it started, for picking the oldest one to steal
+	};
+
+	AudioSink*					m_sink;
+	std::vector<short>			m_clips[MAX_CLIPS];  // a fixed array so adding a clip never moves the others
+	std::atomic<int>			m_numClips;          // published after the clip is filled in
+	int							m_priorities[MAX_CLIPS];
+	std::atomic<int>			m_maxVoices;
+	Command						m_queue[QUEUE_SIZE];
+	std::atomic<unsigned int>	m_queueHead;  // next slot to write; only the game thread stores it
+	std::atomic<unsigned int>	m_queueTail;  // next slot to read; only the mixer thread stores it
+	std::vector<Voice>			m_voices;     // only touched by the mixer thread, never grows past MAX_VOICES
+	std::atomic<bool>			m_quit;
+	std::thread					m_thread;
+
+	bool push(const Command& cmd);
+	void drainCommands();
+	void startVoice(const Command& cmd);
+	void run();
+
+	  // Prevent copying or assigning AudioMixers
+	AudioMixer(const AudioMixer&);
+	AudioMixer& operator=(const AudioMixer&);
+};
+
+#endif // AUDIOMIXER_H_
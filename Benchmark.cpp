@@ -0,0 +1,499 @@
+// Runs the game headless on generated levels and reports how fast it goes.
+//
+//   Benchmark [options] [scenario ...]
+//
+//   --ticks N     ticks to run every scenario for (default 2000)
+//   --seed S      seed for the level layouts and for randInt (default 1)
+//   --parallel    use StudentWorld's parallel actor update
+//   --dir D       where to write the generated level01.txt (default: the current directory)
+//   --max-tick-allocs N
+//                 fail (exit code 2) if any tick allocates more than N times while
+//                 streaming, updating or handing out events.  Every scenario is played
+//                 through once untimed first and the numbers come from playing it again
+//                 in the same world, so 0 checks that nothing allocates once the game has
+//                 warmed up; the first time the index's cells or the actor pool have to
+//                 grow isn't counted
+//   --trace F     write a Chrome trace of the last stretch of the run to F (see Trace.h)
+//   --observe O   after every tick, take an observation the way an agent would: "grid" for
+//                 StudentWorld::observeGrid, or WxH (e.g. 64x64) for observeRGB at that size
+//   --batch K     run K copies of every scenario at once in a WorldBatch (with --parallel
+//                 ignored), observing every tick (the grid unless --observe says otherwise)
+//   --threads N   threads for --batch, counting the main one (default: one per core)
+//
+// A scenario is one of the built-in names below, or a level described as
+// width:goombas:koopas:piranhas:wallPercent:goodieBlocks (e.g. 256:40:20:10:5:8).
+// With no scenarios it runs all of the built-in ones.  Every scenario prints one line
+// of JSON with ticks per second, collision queries per tick, heap allocations and bytes
+// per tick (in total and for each phase of the tick, see AllocStats.h), and the peak
+// resident set size of the process so far (and with --observe, how long an observation
+// takes and how many times taking them allocated, which should be never).  The same seed gives the same levels and the
+// same run on every platform.  Like WorldBatch's worlds, every world plays a level that's read once and kept in memory
+// (see StudentWorld::shareLevel), so no loader thread or disk reads get mixed into the numbers.  Allocations are only counted when built with
+// SPS_COUNT_ALLOCS, which the benchmark project defines; otherwise they show up as null.
+
+#include "StudentWorld.h"
+#include "WorldBatch.h"
+#include "GameConstants.h"
+#include "AllocStats.h"
+#include "Trace.h"
+#include "Level.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+using namespace std;
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+struct Scenario
+{
+	string name;
+	int width;         // in grid cells; the height is always one screen
+	int goombas;
+	int koopas;
+	int piranhas;
+	int wallPercent;   // chance of any empty cell inside the level being a block
+	int goodieBlocks;
+};
+
+static const Scenario builtInScenarios[] = {
+	{ "screen", GRID_WIDTH, 4, 2, 2, 5, 4 },
+	{ "wide", 512, 60, 30, 20, 5, 30 },
+	{ "dense", 128, 200, 100, 50, 15, 40 },
+	{ "huge", 4096, 500, 200, 200, 3, 100 },
+};
+
+  // keys peach gets, one every KEY_INTERVAL ticks: mostly running right, with some jumping,
+  // shooting and backing up
+static const char script[] = "ddddwdddd ddwaaa  dddwdddddwwdd d d";
+static const int KEY_INTERVAL = 3;
+
+static int scriptKey(int tick)
+{
+	switch (script[(tick / KEY_INTERVAL) % (sizeof(script) - 1)])
+	{
+		case 'a':	return KEY_PRESS_LEFT;
+		case 'd':	return KEY_PRESS_RIGHT;
+		case 'w':	return KEY_PRESS_UP;
+		default:	return KEY_PRESS_SPACE;
+	}
+}
+
+static bool parseScenario(const string& arg, Scenario& s)
+{
+	for (size_t i = 0; i < sizeof(builtInScenarios) / sizeof(builtInScenarios[0]); i++)
+	{
+		if (arg == builtInScenarios[i].name)
+		{
+			s = builtInScenarios[i];
+			return true;
+		}
+	}
+	s.name = arg;
+	return sscanf(arg.c_str(), "%d:%d:%d:%d:%d:%d", &s.width, &s.goombas, &s.koopas,
+				  &s.piranhas, &s.wallPercent, &s.goodieBlocks) == 6  &&  s.width >= 4;
+}
+
+  // Writes the scenario as a level file.  Only uses the raw output of mt19937 (the
+  // distributions and std::shuffle differ between standard libraries), so the layout is
+  // the same everywhere.
+
+static bool writeLevel(const string& path, const Scenario& s, unsigned int seed)
+{
+	mt19937 rng(seed);
+	const int w = s.width;
+	const int h = GRID_HEIGHT;
+
+	  // the first row is the top of the level; the top, bottom and sides are solid
+	vector<string> rows(h, string(w, ' '));
+	for (int y = 0; y < h; y++)
+		for (int x = 0; x < w; x++)
+			if (y == 0  ||  y == h - 1  ||  x == 0  ||  x == w - 1  ||  static_cast<int>(rng() % 100) < s.wallPercent)
+				rows[y][x] = '#';
+
+	  // peach starts on the floor on the far left and the flag is on the far right
+	rows[h - 2][1] = '@';
+	rows[h - 2][w - 2] = 'F';
+
+	vector<pair<int, int> > empty;
+	for (int y = 1; y < h - 1; y++)
+		for (int x = 1; x < w - 1; x++)
+			if (rows[y][x] == ' ')
+				empty.push_back(make_pair(x, y));
+	for (size_t i = empty.size(); i > 1; i--)
+		swap(empty[i - 1], empty[rng() % i]);
+
+	size_t next = 0;
+	const char goodies[] = "*^%";
+	const int counts[] = { s.goombas, s.koopas, s.piranhas, s.goodieBlocks };
+	const char kinds[] = { 'G', 'K', 'P', 0 };
+	for (int k = 0; k < 4; k++)
+	{
+		for (int n = 0; n < counts[k]  &&  next < empty.size(); n++, next++)
+		{
+			char c = kinds[k] != 0 ? kinds[k] : goodies[rng() % 3];
+			rows[empty[next].second][empty[next].first] = c;
+		}
+	}
+
+	ofstream out(path.c_str());
+	for (int y = 0; y < h; y++)
+		out << rows[y] << '\n';
+	return static_cast<bool>(out);
+}
+
+static long peakRssKb()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS pmc;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+		return -1;
+	return static_cast<long>(pmc.PeakWorkingSetSize / 1024);
+#else
+	rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return -1;
+#ifdef __APPLE__
+	return static_cast<long>(usage.ru_maxrss / 1024);  // bytes on macOS
+#else
+	return static_cast<long>(usage.ru_maxrss);
+#endif
+#endif
+}
+
+  // allocations in the phases that make up a tick; loading levels and drawing don't count
+static unsigned long long tickAllocs(const AllocStats::Counts& counts)
+{
+	unsigned long long total = 0;
+	for (int p = AllocStats::stream; p <= AllocStats::status; p++)
+		total += counts.allocs[p];
+	return total;
+}
+
+  // what --observe asked for: width 0 for the semantic grid, -1 for none at all
+struct Observation
+{
+	int width;
+	int height;
+};
+
+static bool parseObservation(const string& arg, Observation& o)
+{
+	if (arg == "grid")
+	{
+		o.width = o.height = 0;
+		return true;
+	}
+	char x;
+	return sscanf(arg.c_str(), "%d%c%d", &o.width, &x, &o.height) == 3  &&  x == 'x'  &&  o.width > 0  &&  o.height > 0;
+}
+
+static bool runScenario(const Scenario& s, const string& dir, int ticks, unsigned int seed, bool parallel,
+						const Observation& observe, long long maxTickAllocs, bool& overBudget)
+{
+	if (!writeLevel(dir + "/level01.txt", s, seed))
+	{
+		cerr << "Cannot write a level into " << dir << endl;
+		return false;
+	}
+
+	StudentWorld world(dir);
+	world.setParallelUpdate(parallel);
+	shared_ptr<Level> level(new Level(dir));
+	if (level->loadLevel(StudentWorld::levelFileName(1)) == Level::load_success)
+		world.shareLevel(1, level);
+	seedRandom(seed);
+	if (world.init() != GWSTATUS_CONTINUE_GAME)
+	{
+		cerr << "Cannot load the level for " << s.name << endl;
+		return false;
+	}
+
+	if (maxTickAllocs >= 0)
+	{
+		  // play the whole run once first and then start it over with the same seed.  the second
+		  // run does exactly what the first one did, so whatever the game keeps around (the
+		  // spatial index's cells, the projectile free list, the event buffers) has already grown
+		  // as big as it needs to, and a tick that still allocates would do so every time
+		for (int t = 0; t < ticks; t++)
+		{
+			if (t % KEY_INTERVAL == 0)
+				world.pressKey(scriptKey(t));
+			if (world.move() != GWSTATUS_CONTINUE_GAME)
+			{
+				world.cleanUp();
+				if (world.init() != GWSTATUS_CONTINUE_GAME)
+					return false;
+			}
+		}
+		world.cleanUp();
+		seedRandom(seed);
+		if (world.init() != GWSTATUS_CONTINUE_GAME)
+			return false;
+	}
+
+	int restarts = 0;
+	unsigned long long queries = world.getQueryCount();
+	unsigned long long maxAllocs = 0;
+	AllocStats::Counts before, tickStart, tickEnd;
+
+	vector<unsigned char> observation(observe.width < 0 ? 0 : observe.width == 0 ? GRID_WIDTH * GRID_HEIGHT :
+									  static_cast<size_t>(observe.width) * observe.height * 3);
+	double observeSeconds = 0;
+
+	AllocStats::read(before);
+	tickEnd = before;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+	for (int t = 0; t < ticks; t++)
+	{
+		if (t % KEY_INTERVAL == 0)
+			world.pressKey(scriptKey(t));
+		tickStart = tickEnd;
+		int status = world.move();
+		AllocStats::read(tickEnd);
+		if (tickAllocs(tickEnd) - tickAllocs(tickStart) > maxAllocs)
+			maxAllocs = tickAllocs(tickEnd) - tickAllocs(tickStart);
+		if (status != GWSTATUS_CONTINUE_GAME)
+		{
+			  // died or finished: just play the same level again
+			world.cleanUp();
+			restarts++;
+			if (world.init() != GWSTATUS_CONTINUE_GAME)
+				return false;
+			AllocStats::read(tickEnd);  // the restart itself isn't part of any tick
+		}
+
+		if (observe.width >= 0)
+		{
+			  // timed on its own and left out of ticks per second, so the numbers stay comparable
+			chrono::steady_clock::time_point observeStart = chrono::steady_clock::now();
+			if (observe.width == 0)
+				world.observeGrid(observation.data());
+			else
+				world.observeRGB(observation.data(), observe.width, observe.height);
+			chrono::steady_clock::time_point observeEnd = chrono::steady_clock::now();
+			observeSeconds += chrono::duration<double>(observeEnd - observeStart).count();
+			start += observeEnd - observeStart;
+		}
+	}
+
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	AllocStats::Counts after;
+	AllocStats::read(after);
+	queries = world.getQueryCount() - queries;
+	world.cleanUp();
+
+	printf("{\"scenario\":\"%s\",\"width\":%d,\"goombas\":%d,\"koopas\":%d,\"piranhas\":%d,"
+		   "\"wall_percent\":%d,\"goodie_blocks\":%d,\"seed\":%u,\"parallel\":%s,\"ticks\":%d,"
+		   "\"restarts\":%d,\"seconds\":%.6f,\"ticks_per_sec\":%.1f,\"queries_per_tick\":%.2f,",
+		   s.name.c_str(), s.width, s.goombas, s.koopas, s.piranhas, s.wallPercent, s.goodieBlocks,
+		   seed, parallel ? "true" : "false", ticks, restarts, seconds,
+		   seconds > 0 ? ticks / seconds : 0.0, static_cast<double>(queries) / ticks);
+	if (AllocStats::enabled())
+	{
+		unsigned long long allocs = 0, bytes = 0;
+		for (int p = 0; p < AllocStats::NUM_PHASES; p++)
+		{
+			allocs += after.allocs[p] - before.allocs[p];
+			bytes += after.bytes[p] - before.bytes[p];
+		}
+		printf("\"allocs_per_tick\":%.2f,\"alloc_bytes_per_tick\":%.1f,\"max_tick_allocs\":%llu,\"allocs_by_phase\":{",
+			   static_cast<double>(allocs) / ticks, static_cast<double>(bytes) / ticks, maxAllocs);
+		for (int p = 0; p < AllocStats::NUM_PHASES; p++)
+			printf("%s\"%s\":%.2f", p > 0 ? "," : "", AllocStats::phaseName(p),
+				   static_cast<double>(after.allocs[p] - before.allocs[p]) / ticks);
+		printf("},");
+	}
+	else
+		printf("\"allocs_per_tick\":null,\"alloc_bytes_per_tick\":null,\"max_tick_allocs\":null,\"allocs_by_phase\":null,");
+	if (observe.width >= 0)
+	{
+		char name[32];
+		if (observe.width == 0)
+			snprintf(name, sizeof(name), "grid");
+		else
+			snprintf(name, sizeof(name), "%dx%d", observe.width, observe.height);
+		printf("\"observe\":\"%s\",\"observe_us\":%.3f,", name, observeSeconds * 1e6 / ticks);
+		if (AllocStats::enabled())
+			printf("\"observe_allocs\":%llu,", after.allocs[AllocStats::observe] - before.allocs[AllocStats::observe]);
+		else
+			printf("\"observe_allocs\":null,");
+	}
+	printf("\"peak_rss_kb\":%ld}\n", peakRssKb());
+	fflush(stdout);
+
+	if (maxTickAllocs >= 0  &&  static_cast<long long>(maxAllocs) > maxTickAllocs)
+	{
+		cerr << s.name << ": a tick allocated " << maxAllocs << " times, more than the " << maxTickAllocs << " allowed" << endl;
+		overBudget = true;
+	}
+	return true;
+}
+
+  // Like runScenario, but for a batch of worlds all playing the scenario, each with the
+  // script offset by its index.  Ticks per second counts every world's ticks.
+
+static bool runBatch(const Scenario& s, const string& dir, int ticks, unsigned int seed, int numWorlds,
+					 int threads, const Observation& observe)
+{
+	if (!writeLevel(dir + "/level01.txt", s, seed))
+	{
+		cerr << "Cannot write a level into " << dir << endl;
+		return false;
+	}
+
+	WorldBatch batch(dir, numWorlds, observe.width < 0 ? 0 : observe.width, observe.height, seed, 1,
+					 threads > 0 ? threads - 1 : 0);
+	if (!batch.reset())
+	{
+		cerr << "Cannot load the level for " << s.name << endl;
+		return false;
+	}
+
+	vector<int> keys(numWorlds);
+	double points = 0;
+	AllocStats::Counts before, after;
+	AllocStats::read(before);
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+	for (int t = 0; t < ticks; t++)
+	{
+		for (int i = 0; i < numWorlds; i++)
+			keys[i] = (t + i) % KEY_INTERVAL == 0 ? scriptKey(t + i) : -1;
+		if (!batch.step(keys.data()))
+		{
+			cerr << "Cannot restart a world for " << s.name << endl;
+			return false;
+		}
+		for (int i = 0; i < numWorlds; i++)
+			points += batch.rewards()[i];
+	}
+
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	AllocStats::read(after);
+
+	printf("{\"scenario\":\"%s\",\"width\":%d,\"seed\":%u,\"worlds\":%d,\"threads\":%d,\"ticks\":%d,"
+		   "\"restarts\":%lld,\"points\":%.0f,\"seconds\":%.6f,\"world_ticks_per_sec\":%.1f,\"observe\":",
+		   s.name.c_str(), s.width, seed, numWorlds, batch.numThreads(), ticks, batch.getRestarts(), points, seconds,
+		   seconds > 0 ? static_cast<double>(ticks) * numWorlds / seconds : 0.0);
+	if (observe.width > 0)
+		printf("\"%dx%d\",", observe.width, observe.height);
+	else
+		printf("\"grid\",");
+	if (AllocStats::enabled())
+	{
+		unsigned long long allocs = 0;
+		for (int p = 0; p < AllocStats::NUM_PHASES; p++)
+			allocs += after.allocs[p] - before.allocs[p];
+		printf("\"allocs_per_world_tick\":%.2f,\"observe_allocs\":%llu,",
+			   static_cast<double>(allocs) / ticks / numWorlds, after.allocs[AllocStats::observe] - before.allocs[AllocStats::observe]);
+	}
+	else
+		printf("\"allocs_per_world_tick\":null,\"observe_allocs\":null,");
+	printf("\"peak_rss_kb\":%ld}\n", peakRssKb());
+	fflush(stdout);
+	return true;
+}
+
+int main(int argc, char* argv[])
+{
+	int ticks = 2000;
+	unsigned int seed = 1;
+	bool parallel = false;
+	long long maxTickAllocs = -1;
+	const char* traceTo = nullptr;
+	Observation observe = { -1, -1 };
+	int batchWorlds = 0;
+	int threads = 0;
+	string dir = ".";
+	vector<Scenario> scenarios;
+
+	for (int i = 1; i < argc; i++)
+	{
+		string arg = argv[i];
+		if (arg == "--ticks"  &&  i + 1 < argc)
+			ticks = atoi(argv[++i]);
+		else if (arg == "--seed"  &&  i + 1 < argc)
+			seed = static_cast<unsigned int>(strtoul(argv[++i], nullptr, 10));
+		else if (arg == "--dir"  &&  i + 1 < argc)
+			dir = argv[++i];
+		else if (arg == "--parallel")
+			parallel = true;
+		else if (arg == "--max-tick-allocs"  &&  i + 1 < argc)
+			maxTickAllocs = atoll(argv[++i]);
+		else if (arg == "--trace"  &&  i + 1 < argc)
+			traceTo = argv[++i];
+		else if (arg == "--batch"  &&  i + 1 < argc)
+			batchWorlds = atoi(argv[++i]);
+		else if (arg == "--threads"  &&  i + 1 < argc)
+			threads = atoi(argv[++i]);
+		else if (arg == "--observe"  &&  i + 1 < argc)
+		{
+			if (!parseObservation(argv[++i], observe))
+			{
+				cerr << "--observe takes grid or WxH, not " << argv[i] << endl;
+				return 1;
+			}
+		}
+		else
+		{
+			Scenario s;
+			if (!parseScenario(arg, s))
+			{
+				cerr << "Unknown scenario " << arg << endl;
+				return 1;
+			}
+			scenarios.push_back(s);
+		}
+	}
+	if (ticks < 1)
+	{
+		cerr << "--ticks has to be at least 1" << endl;
+		return 1;
+	}
+	if (batchWorlds < 0  ||  threads < 0)
+	{
+		cerr << "--batch and --threads can't be negative" << endl;
+		return 1;
+	}
+	if (maxTickAllocs >= 0  &&  !AllocStats::enabled())
+	{
+		cerr << "--max-tick-allocs needs a build with SPS_COUNT_ALLOCS" << endl;
+		return 1;
+	}
+	if (scenarios.empty())
+		scenarios.assign(builtInScenarios, builtInScenarios + sizeof(builtInScenarios) / sizeof(builtInScenarios[0]));
+
+	if (traceTo != nullptr)
+		Trace::start();
+	Trace::nameThread("benchmark");
+	bool overBudget = false;
+	for (size_t i = 0; i < scenarios.size(); i++)
+	{
+		if (batchWorlds > 0)
+		{
+			if (!runBatch(scenarios[i], dir, ticks, seed, batchWorlds, threads, observe))
+				return 1;
+		}
+		else if (!runScenario(scenarios[i], dir, ticks, seed, parallel, observe, maxTickAllocs, overBudget))
+			return 1;
+	}
+	if (traceTo != nullptr  &&  !Trace::stop(traceTo))
+	{
+		cerr << "Cannot write the trace to " << traceTo << endl;
+		return 1;
+	}
+	return overBudget ? 2 : 0;
+}
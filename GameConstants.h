@@ -35,6 +35,7 @@ const int SOUND_FINISHED_LEVEL = 8;
 const int SOUND_GAME_OVER = 9;
 const int SOUND_PIRANHA_FIRE = 10;
 const int SOUND_THEME = 11;
+const int NUM_SOUNDS = 12;
 const int SOUND_NONE = -1;
 
 // keys the user can hit
@@ -59,6 +60,10 @@ const int SPRITE_HEIGHT = 8;
 const int GRID_WIDTH = VIEW_WIDTH / SPRITE_WIDTH;
 const int GRID_HEIGHT = VIEW_HEIGHT / SPRITE_HEIGHT;
 
+// actors further than this (in pixels) from peach are asleep until she gets closer
+
+const int ACTIVATION_MARGIN = VIEW_WIDTH;
+
 const double SPRITE_WIDTH_GL = .3; // note - this is tied implicitly to SPRITE_WIDTH due to carey's sloppy openGL programming
 const double SPRITE_HEIGHT_GL = .25; // note - this is tied implicitly to SPRITE_HEIGHT due to carey's sloppy openGL programming
 
@@ -74,6 +79,38 @@ const int GWSTATUS_LEVEL_ERROR    = 4;
 
 const int NUM_TEST_PARAMS = 1;
 
+// Where randInt on this thread draws from instead of the shared generator, if anywhere.
+// A world that moves on a different thread from other worlds points this at its own
+// generator while it runs, so the worlds neither race on one generator nor change each
+// other's numbers.
+
+inline
+std::default_random_engine*& threadRandomEngine()
+{
+    static thread_local std::default_random_engine* engine = nullptr;
+    return engine;
+}
+
+// The generator behind randInt, seeded randomly the first time it's used
+
+inline
+std::default_random_engine& randomEngine()
+{
+    if (threadRandomEngine() != nullptr)
+        return *threadRandomEngine();
+    static std::random_device rd;
+    static std::default_random_engine generator(rd());
+    return generator;
+}
+
+// Reseed randInt, so that a run can be repeated exactly
+
+inline
+void seedRandom(unsigned int seed)
+{
+    randomEngine().seed(seed);
+}
+
 // Return a uniformly distributed random int from min to max, inclusive
 
 inline
@@ -81,10 +118,8 @@ int randInt(int min, int max)
 {
     if (max < min)
         std::swap(max, min);
-    static std::random_device rd;
-    static std::default_random_engine generator(rd());
     std::uniform_int_distribution<> distro(min, max);
-    return distro(generator);
+    return distro(randomEngine());
 }
 
 #endif // GAMECONSTANTS_H_
@@ -5,6 +5,9 @@
 #include "GraphObject.h"
 #include "SoundFX.h"
 #include "SpriteManager.h"
+#include "AllocStats.h"
+#include "Trace.h"
+#include "Metrics.h"
 #include <cstdio>
 #include <string>
 #include <map>
@@ -12,6 +15,7 @@
 #include <cstdlib>
 #include <algorithm>
 #include <iostream>
+#include <vector>
 using namespace std;
 
 /*
@@ -53,6 +57,7 @@ static const double SCORE_Z = -10;
 static const int MS_PER_FRAME = 5;
 
 int GameController::m_ms_per_tick = kDefaultMsPerTick;
+int GameController::m_soundCoalesceTicks = kDefaultSoundCoalesceTicks;
 
 struct SpriteInfo
 {
@@ -62,14 +67,26 @@ struct SpriteInfo
 	std::string imageName;
 };
 
+struct SoundInfo
+{
+	int soundID;
+	std::string wavFileName;
+	int priority;  // which sounds get cut off first when too many play at once
+};
+
 static void convertToGlutCoords(double x, double y, double& gx, double& gy, double& gz);
-static void drawPrompt(string mainMessage, string secondMessage);
-static void drawScoreAndLives(string);
+static void drawPrompt(const string& mainMessage, const string& secondMessage);
+static void drawScoreAndLives(const string&);
 
 enum GameController::GameControllerState : int {
 	welcome, contgame, finishedlevel, init, cleanup, makemove, animate, gameover, prompt, quit, not_applicable
 };
 
+  // what each state's step shows up as in a trace
+static const char* const stateNames[] = {
+	"welcome", "contgame", "finishedlevel", "init", "cleanup", "makemove", "animate", "gameover", "prompt", "quit", "not_applicable"
+};
+
 void GameController::initDrawersAndSounds()
 {
 	SpriteInfo drawers[] = {
@@ -93,40 +110,65 @@ void GameController::initDrawersAndSounds()
 	{ IID_PEACH_FIRE, 0, "fireball.tga", "PEACH_FIRE" },
 	};
 
-	SoundMapType::value_type sounds[] = {
-		make_pair(SOUND_PLAYER_DIE    , "die.wav"),
-		make_pair(SOUND_PLAYER_FIRE   , "fire.wav"),
-		make_pair(SOUND_PLAYER_HURT   ,	"hurt.wav"),
-		make_pair(SOUND_PLAYER_JUMP   , "jump.wav"),
-		make_pair(SOUND_PLAYER_BONK   , "bonk.wav"),
-		make_pair(SOUND_PLAYER_POWERUP, "powerup.wav"),
-		make_pair(SOUND_POWERUP_APPEARS, "powerup_appears.wav"),
-		make_pair(SOUND_PLAYER_KICK, "kick.wav"),
-		make_pair(SOUND_FINISHED_LEVEL, "finished.wav"),
-		make_pair(SOUND_GAME_OVER, "gameover.wav"),
-		make_pair(SOUND_PIRANHA_FIRE, "piranha_fire.wav"),
-		make_pair(SOUND_THEME         , "theme.wav"),
+	SoundInfo sounds[] = {
+	{ SOUND_PLAYER_DIE, "die.wav", 3 },
+	{ SOUND_PLAYER_FIRE, "fire.wav", 1 },
+	{ SOUND_PLAYER_HURT, "hurt.wav", 2 },
+	{ SOUND_PLAYER_JUMP, "jump.wav", 1 },
+	{ SOUND_PLAYER_BONK, "bonk.wav", 0 },
+	{ SOUND_PLAYER_POWERUP, "powerup.wav", 2 },
+	{ SOUND_POWERUP_APPEARS, "powerup_appears.wav", 2 },
+	{ SOUND_PLAYER_KICK, "kick.wav", 0 },
+	{ SOUND_FINISHED_LEVEL, "finished.wav", 3 },
+	{ SOUND_GAME_OVER, "gameover.wav", 3 },
+	{ SOUND_PIRANHA_FIRE, "piranha_fire.wav", 1 },
+	{ SOUND_THEME, "theme.wav", 3 },
 	};
 
+	string path = m_gw->assetPath();
+	if (!path.empty())
+		path += '/';
+
+	  // use the asset pack if there is one (a single file open and map), otherwise the loose files
+	bool packed = m_assetPack.open(path + ASSET_PACK_NAME);
+
+	  // decode every sprite at once so the work gets spread over all the cores
+	vector<SpriteManager::SpriteSource> sources;
 	for (int k = 0; k < sizeof(drawers) / sizeof(drawers[0]); k++)
 	{
-		string path = m_gw->assetPath();
-		if (!path.empty())
-			path += '/';
 		const SpriteInfo& d = drawers[k];
-		if (!m_spriteManager.loadSprite(path + d.tgaFileName, d.imageID, d.frameNum)) {
-			fprintf(stderr, "Error loading sprite: %s\n", (path + d.tgaFileName).c_str());
-			exit(0);
-		}
+		SpriteManager::SpriteSource source = { d.imageID, d.frameNum, path + d.tgaFileName, nullptr, 0 };
+		if (packed)
+			m_assetPack.find(d.tgaFileName, source.data, source.size);
+		sources.push_back(source);
 		m_imageNameMap[d.imageID] = d.imageName;
 	}
+	int failed;
+	{
+		Trace::Scope span("load sprites");
+		failed = m_spriteManager.loadSprites(sources);
+	}
+	if (failed >= 0) {
+		fprintf(stderr, "Error loading sprite: %s\n", sources[failed].fileName.c_str());
+		exit(0);
+	}
 	for (int k = 0; k < sizeof(sounds) / sizeof(sounds[0]); k++)
-		m_soundMap[sounds[k].first] = sounds[k].second;
-}
-
-static void doSomethingCallback()
-{
-	Game().doSomething();
+	{
+		  // resolve each sound once here so playSound doesn't have to build a path every time
+		const string& name = sounds[k].wavFileName;
+		Trace::Scope span("load sound", name.c_str());
+		const char* data;
+		size_t size;
+		int clip = -1;
+		if (packed  &&  m_assetPack.find(name, data, size))
+			clip = SoundFX().loadClip(name, data, size);
+		if (clip < 0)
+			clip = SoundFX().preloadClip(path + name);  // decode it now rather than on the first play
+		if (clip >= 0)
+			SoundFX().setClipPriority(clip, sounds[k].priority);
+		m_soundClips[sounds[k].soundID] = clip;
+		m_soundNames[sounds[k].soundID] = name;
+	}
 }
 
 static void reshapeCallback(int w, int h)
@@ -147,7 +189,18 @@ static void specialKeyboardEventCallback(int key, int x, int y)
 void GameController::timerFuncCallback(int)
 {
 	Game().doSomething();
-	glutTimerFunc(MS_PER_FRAME, timerFuncCallback, 0);
+	  // when nothing can change until the user hits a key, let GLUT sleep until one comes in
+	if (Game().isIdle())
+		Game().m_timerStopped = true;
+	else
+		glutTimerFunc(MS_PER_FRAME, timerFuncCallback, 0);
+}
+
+void GameController::displayCallback()
+{
+	Game().m_needsRedraw = true;
+	Game().doSomething();
+	Game().wake();
 }
 
 #if defined(__APPLE__)
@@ -161,12 +214,19 @@ void GameController::run(int argc, char* argv[], GameWorld* gw, string windowTit
 {
 	gw->setController(this);
 	m_gw = gw;
+	GraphObject::setTracking(true);  // for the leak report; the world hasn't made any objects yet
 	setGameState(welcome);
 	m_lastKeyHit = INVALID_KEY;
 	m_singleStep = false;
 	m_curIntraFrameTick = 0;
 	m_playerWon = false;
 
+	  // SPS_TRACE=file writes a Chrome trace of the run to file when the game quits
+	const char* traceTo = getenv("SPS_TRACE");
+	if (traceTo != nullptr)
+		Trace::start();
+	Trace::nameThread("game");
+
 	glutInit(&argc, argv);
 
 	glutInitDisplayMode(GLUT_RGB | GLUT_DEPTH | GLUT_DOUBLE);
@@ -179,18 +239,54 @@ void GameController::run(int argc, char* argv[], GameWorld* gw, string windowTit
 	glutKeyboardFunc(keyboardEventCallback);
 	glutSpecialFunc(specialKeyboardEventCallback);
 	glutReshapeFunc(reshapeCallback);
-	glutDisplayFunc(doSomethingCallback);
+	glutDisplayFunc(displayCallback);
 	glutTimerFunc(MS_PER_FRAME, timerFuncCallback, 0);
 #if defined(__APPLE__)
 	glutWMCloseFunc(windowCloseCallback);
 #endif
 
+	const char* recordTo = getenv("SPS_RECORD");
+	if (recordTo != nullptr)
+		startRecording(recordTo);
+
+	  // SPS_METRICS=socket serves a snapshot of the counters in Metrics.h to anyone who connects
+	const char* metricsSocket = getenv("SPS_METRICS");
+	if (metricsSocket != nullptr)
+		Metrics::startPublisher(metricsSocket);
+
 	glutSetOption(GLUT_ACTION_ON_WINDOW_CLOSE, GLUT_ACTION_GLUTMAINLOOP_RETURNS);
 	glutMainLoop();
+	if (m_recording.is_open())
+		m_recording << "ticks " << m_tickCount << endl;
+	Metrics::stopPublisher();
 	delete m_gw;
+	if (traceTo != nullptr  &&  !Trace::stop(traceTo))  // the world's threads are gone by now
+		cerr << "Cannot write the trace to " << traceTo << endl;
 	reportLeakedGraphObjects();
 }
 
+void GameController::startRecording(const char* fileName)
+{
+	m_recording.open(fileName);
+	if (!m_recording)
+	{
+		cerr << "Cannot record to " << fileName << endl;
+		return;
+	}
+	  // pick the seed ourselves so that the replay can start from the same one
+	unsigned int seed = random_device()();
+	seedRandom(seed);
+	m_recording << "# recorded playthrough: a key the world read on a tick is \"tick key\"" << endl;
+	m_recording << "seed " << seed << endl;
+	m_recording << "level " << m_gw->getLevel() << endl;
+}
+
+void GameController::recordKey(int key)
+{
+	if (m_recording.is_open())
+		m_recording << m_tickCount - 1 << ' ' << key << '\n';  // m_tickCount was already bumped for this tick
+}
+
 void GameController::keyboardEvent(unsigned char key, int /* x */, int /* y */)
 {
 	switch (key)
@@ -205,6 +301,7 @@ void GameController::keyboardEvent(unsigned char key, int /* x */, int /* y */)
 	case 'q': case 'Q': setGameState(quit);				break;
 	default:			m_lastKeyHit = key;				break;
 	}
+	wake();
 }
 
 void GameController::specialKeyboardEvent(int key, int /* x */, int /* y */)
@@ -217,27 +314,58 @@ void GameController::specialKeyboardEvent(int key, int /* x */, int /* y */)
 	case GLUT_KEY_DOWN:	 m_lastKeyHit = KEY_PRESS_DOWN;	 break;
 	default:			 m_lastKeyHit = INVALID_KEY;	 break;
 	}
+	wake();
 }
 
 void GameController::playSound(int soundID)
 {
-	if (soundID == SOUND_NONE)
+	  // this runs in the middle of a tick, so it just hands SoundFX a preloaded clip handle
+	if (soundID < 0  ||  soundID >= NUM_SOUNDS)  // includes SOUND_NONE
 		return;
 
-	SoundMapType::const_iterator p = m_soundMap.find(soundID);
-	if (p != m_soundMap.end())
-	{
-		string path = m_gw->assetPath();
-		if (!path.empty())
-			path += '/';
-		SoundFX().playClip(path + p->second);
-	}
+	int clip = m_soundClips[soundID];
+	if (clip < 0)
+		return;
+
+	  // a star-powered Peach can kick a whole row of enemies in one tick; one kick is plenty
+	if (m_tickCount < m_soundNextTick[soundID])
+		return;
+	m_soundNextTick[soundID] = m_tickCount + m_soundCoalesceTicks;
+
+	  // this is when the game asked for the sound; with every voice busy the mixer may still drop it
+	Trace::mark("sound request", m_soundNames[soundID].c_str());
+	Metrics::soundPlayed();
+	SoundFX().playClip(clip, m_tickCount);
 }
 
 void GameController::setGameState(GameControllerState s)
 {
 	if (m_gameState != quit)
+	{
 		m_gameState = s;
+		m_needsRedraw = true;
+		Metrics::setState(stateNames[s]);
+	}
+}
+
+  // Nothing will happen until a key is hit: we're sitting at a prompt, or single-stepping and
+  // done animating the last tick.
+bool GameController::isIdle() const
+{
+	if (m_needsRedraw)
+		return false;
+	if (m_gameState == prompt)
+		return true;
+	return m_gameState == animate  &&  m_singleStep  &&  m_curIntraFrameTick < 0  &&  m_nextStateAfterAnimate == not_applicable;
+}
+
+void GameController::wake()
+{
+	if (m_timerStopped)
+	{
+		m_timerStopped = false;
+		glutTimerFunc(0, timerFuncCallback, 0);
+	}
 }
 void GameController::quitGame()
 {
@@ -246,6 +374,7 @@ void GameController::quitGame()
 
 void GameController::doSomething()
 {
+	Trace::Scope span(stateNames[m_gameState]);
 	switch (m_gameState)
 	{
 	case not_applicable:
@@ -270,6 +399,8 @@ void GameController::doSomething()
 		m_nextStateAfterPrompt = cleanup;
 		break;
 	case makemove:
+		m_tickCount++;
+		Metrics::tick();
 		m_curIntraFrameTick = ANIMATION_POSITIONS_PER_TICK;
 		m_nextStateAfterAnimate = not_applicable;
 		{
@@ -294,7 +425,9 @@ void GameController::doSomething()
 		setGameState(animate);
 		break;
 	case animate:
-		displayGamePlay();
+		  // once the last tick is done animating, a single-stepping game just waits for a key
+		if (m_curIntraFrameTick >= 0  ||  m_needsRedraw)
+			displayGamePlay();
 		if (m_curIntraFrameTick-- <= 0)
 		{
 			if (m_nextStateAfterAnimate != not_applicable)
@@ -323,7 +456,11 @@ void GameController::doSomething()
 	m_nextStateAfterPrompt = quit;
 	break;
 	case prompt:
-		drawPrompt(m_mainMessage, m_secondMessage);
+		if (m_needsRedraw)
+		{
+			drawPrompt(m_mainMessage, m_secondMessage);
+			m_needsRedraw = false;
+		}
 		{
 			int key;
 			if (getLastKey(key) && key == '\r')
@@ -360,6 +497,9 @@ void GameController::doSomething()
 
 void GameController::displayGamePlay()
 {
+	AllocStats::Scope phase(AllocStats::render);
+	Trace::Scope span("draw");
+	Metrics::frame();
 	glEnable(GL_DEPTH_TEST); // must be done each time before displaying graphics or gets disabled for some reason
 	glLoadIdentity();
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -372,20 +512,25 @@ void GameController::displayGamePlay()
 #pragma GCC diagnostic pop
 #endif
 
+	  // only ask for what overlaps the camera, widened by a sprite so partially visible objects still get drawn
+	int camX = m_gw->getCameraX();
+	int camY = m_gw->getCameraY();
+	m_visibleObjects.clear();
+	m_gw->getVisibleObjects(camX - SPRITE_WIDTH, camY - SPRITE_HEIGHT, camX + VIEW_WIDTH + SPRITE_WIDTH - 1,
+							camY + VIEW_HEIGHT + SPRITE_HEIGHT - 1, m_visibleObjects);
+
 	for (int i = GraphObject::NUM_DEPTHS - 1; i >= 0; --i)
 	{
-		std::set<GraphObject*>& graphObjects = GraphObject::getGraphObjects(i);
-
-		for (auto it = graphObjects.begin(); it != graphObjects.end(); it++)
+		for (auto it = m_visibleObjects.begin(); it != m_visibleObjects.end(); it++)
 		{
 			GraphObject* cur = *it;
-			if (cur->isVisible())
+			if (cur->getDepth() == i && cur->isVisible())
 			{
 				cur->animate();
 
 				double x, y, gx, gy, gz;
 				cur->getAnimationLocation(x, y);
-				convertToGlutCoords(x, y, gx, gy, gz);
+				convertToGlutCoords(x - camX, y - camY, gx, gy, gz);
 
 				int angle = cur->getDirection();
 				int imageID = cur->getID();
@@ -398,6 +543,7 @@ void GameController::displayGamePlay()
 	drawScoreAndLives(m_gameStatText);
 
 	glutSwapBuffers();
+	m_needsRedraw = false;
 }
 
 void GameController::reportLeakedGraphObjects() const
@@ -423,6 +569,7 @@ void GameController::reportLeakedGraphObjects() const
 
 void GameController::reshape(int w, int h)
 {
+	m_needsRedraw = true;
 	glViewport(0, 0, (GLsizei)w, (GLsizei)h);
 	glMatrixMode(GL_PROJECTION);
 	glLoadIdentity();
@@ -475,24 +622,63 @@ static void outputStrokeCentered(double y, double z, const char* str)
 	doOutputStroke(0, y, z, 1, str, true);
 }
 
-static void drawPrompt(string mainMessage, string secondMessage)
+  // A centered line of stroke-font text.  Measuring it and walking its characters is only done
+  // when the text changes; the result is compiled into a display list that gets replayed on
+  // every other frame.  The color isn't part of the list, so it can still change every frame.
+
+class CachedStrokeText
+{
+  public:
+	CachedStrokeText()
+	 : m_list(0), m_y(0), m_z(0)
+	{}
+
+	void draw(double y, double z, const string& text)
+	{
+		bool fresh = (m_list == 0);
+		if (fresh)
+			m_list = glGenLists(1);
+		if (fresh  ||  text != m_text  ||  y != m_y  ||  z != m_z)
+		{
+			glNewList(m_list, GL_COMPILE);
+			outputStrokeCentered(y, z, text.c_str());
+			glEndList();
+			m_text = text;
+			m_y = y;
+			m_z = z;
+		}
+		glCallList(m_list);
+	}
+
+  private:
+	GLuint	m_list;
+	string	m_text;
+	double	m_y, m_z;
+};
+
+static void drawPrompt(const string& mainMessage, const string& secondMessage)
 {
+	static CachedStrokeText mainText, secondText;
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	glColor3f(1.0, 1.0, 1.0);
 	glLoadIdentity();
-	outputStrokeCentered(1, -5, mainMessage.c_str());
-	outputStrokeCentered(-1, -5, secondMessage.c_str());
+	mainText.draw(1, -5, mainMessage);
+	secondText.draw(-1, -5, secondMessage);
 	glutSwapBuffers();
 }
 
-static void drawScoreAndLives(string gameStatText)
+static void drawScoreAndLives(const string& gameStatText)
 {
 	static int RATE = 1;
 	static GLfloat rgb[3] =
 	{ static_cast<GLfloat>(.6), static_cast<GLfloat>(.6), static_cast<GLfloat>(.6) };
+	  // the shimmer has its own generator, so drawing frames doesn't change what randInt
+	  // gives the game (which would make recorded playthroughs impossible to replay)
+	static default_random_engine shimmer;
+	uniform_int_distribution<int> step(-RATE, RATE);
 	for (int k = 0; k < 3; k++)
 	{
-		double strength = rgb[k] + (-RATE + randInt(0, 2 * RATE)) / 100.0;
+		double strength = rgb[k] + step(shimmer) / 100.0;
 		if (strength < .6)
 			strength = .6;
 		else if (strength > 1.0)
@@ -500,5 +686,6 @@ static void drawScoreAndLives(string gameStatText)
 		rgb[k] = static_cast<GLfloat>(strength);
 	}
 	glColor3f(rgb[0], rgb[1], rgb[2]);
-	outputStrokeCentered(SCORE_Y, SCORE_Z, gameStatText.c_str());
+	static CachedStrokeText statText;
+	statText.draw(SCORE_Y, SCORE_Z, gameStatText);
 }
\ No newline at end of file
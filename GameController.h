@@ -2,10 +2,14 @@
 #define GAMECONTROLLER_H_
 
 #include "SpriteManager.h"
+#include "AssetPack.h"
+#include "GameConstants.h"
 #include <string>
 #include <map>
 #include <iostream>
 #include <sstream>
+#include <fstream>
+#include <vector>
 const int INVALID_KEY = 0;
 
 class GraphObject;
@@ -29,9 +33,10 @@ public:
 
 	void playSound(int soundID);
 
-	void setGameStatText(std::string text)
+	  // assign() reuses m_gameStatText's buffer, so this only allocates if the text outgrows it
+	void setGameStatText(const char* text)
 	{
-		m_gameStatText = text;
+		m_gameStatText.assign(text);
 	}
 
 	void doSomething();
@@ -50,11 +55,29 @@ public:
 	}
 
 	static void timerFuncCallback(int nothing);
+	static void displayCallback();
 	void setMsPerTick(int ms_per_tick) { m_ms_per_tick = ms_per_tick; }
+	  // a sound asked for again within this many ticks of starting only plays once
+	void setSoundCoalesceTicks(int ticks) { m_soundCoalesceTicks = ticks; }
+
+	  // Running with SPS_RECORD=file records the playthrough: the seed randInt
+	  // starts from and every key the world reads, by tick.  The Regression tool
+	  // replays these files.  GameWorld::getKey reports each key here.
+	void recordKey(int key);
 
 private:
 	enum GameControllerState : int;
 
+	GameController()
+	 : m_tickCount(0), m_needsRedraw(false), m_timerStopped(false)
+	{
+		for (int k = 0; k < NUM_SOUNDS; k++)
+		{
+			m_soundClips[k] = -1;
+			m_soundNextTick[k] = 0;
+		}
+	}
+
 	GameWorld* m_gw;
 	GameControllerState	m_gameState;
 	GameControllerState	m_nextStateAfterPrompt;
@@ -65,22 +88,34 @@ private:
 	std::string m_mainMessage;
 	std::string m_secondMessage;
 	int			m_curIntraFrameTick;
-	using SoundMapType = std::map<int, std::string>;
 	using DrawMapType = std::map<int, std::string>;
 	using ImageNameMapType = std::map<int, std::string>;
-	SoundMapType m_soundMap;
+	int			m_soundClips[NUM_SOUNDS]; // SoundFX clip handle for each sound ID, -1 if it didn't load
+	std::string m_soundNames[NUM_SOUNDS]; // file each sound ID plays, for the trace
+	unsigned int m_tickCount; // ticks the world has been moved, stamped on every sound
+	unsigned int m_soundNextTick[NUM_SOUNDS]; // repeats of a sound before this tick are dropped
 	ImageNameMapType m_imageNameMap;
 	bool		m_playerWon;
 	SpriteManager m_spriteManager;
+	AssetPack	m_assetPack; // mapped for the whole run, sprites and sounds are read straight out of it
+	std::vector<GraphObject*> m_visibleObjects; // reused every frame so drawing doesn't allocate
+	std::ofstream m_recording; // only open while recording a playthrough
+	bool		m_needsRedraw;  // the screen is out of date: the state changed or the window was exposed or resized
+	bool		m_timerStopped; // idle, so the frame timer isn't rescheduled until something wakes us up
 
 	void setGameState(GameControllerState s);
+	bool isIdle() const;
+	void wake();
 
+	void startRecording(const char* fileName);
 	void initDrawersAndSounds();
 	void displayGamePlay();
 	void reportLeakedGraphObjects() const;
 
 	static const int kDefaultMsPerTick = 10;
 	static int m_ms_per_tick;
+	static const int kDefaultSoundCoalesceTicks = 2;
+	static int m_soundCoalesceTicks;
 };
 
 inline GameController& Game()
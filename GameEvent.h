@@ -0,0 +1,29 @@
+#ifndef GAMEEVENT_H_
+#define GAMEEVENT_H_
+
+class Actor;
+
+// Something an actor wants to happen to the rest of the world. Actors don't reach into the world or into each other
+// while they update, they post one of these to StudentWorld instead and the world applies it (see StudentWorld::move).
+// The world keeps every event posted during a tick in the order it was applied, so the list doubles as a log.
+
+struct GameEvent {
+	enum Type : unsigned char {
+		score,    // value = points
+		sound,    // value = sound ID
+		spawn,    // value = image ID of what to create at (x, y) facing dir
+		damage,   // target gets bonk()'ed
+		powerup,  // peach gets value as her powerup (1 mushroom, 2 flower, 3 star)
+		levelEnd, // value = 1 for mario (the game is over), 0 for a flag
+		move,     // parallel updates only: target (the poster) moves to (x, y)
+		die       // parallel updates only: target (the poster) dies
+	};
+
+	Type type;
+	int source;     // spawn order of the actor that posted it, -1 if it didn't come from an actor
+	Actor* target;  // only for damage, move and die, and only valid during the tick it was posted in
+	int value;
+	int x, y, dir;
+};
+
+#endif // GAMEEVENT_H_
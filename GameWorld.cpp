@@ -1,15 +1,26 @@
 #include "GameWorld.h"
 #include "GameController.h"
+#include "GraphObject.h"
 #include <string>
 #include <cstdlib>
 using namespace std;
 
 bool GameWorld::getKey(int& value)
 {
+	if (m_controller == nullptr)
+	{
+		if (m_pendingKey == NO_KEY)
+			return false;
+		value = m_pendingKey;
+		m_pendingKey = NO_KEY;
+		return true;
+	}
+
 	bool gotKey = m_controller->getLastKey(value);
 
 	if (gotKey)
 	{
+		m_controller->recordKey(value);
 		if (value == 'q'  ||  value == '\x03')  // CTRL-C
 			m_controller->quitGame();
 	}
@@ -18,15 +29,33 @@ bool GameWorld::getKey(int& value)
 
 void GameWorld::playSound(int soundID)
 {
-	m_controller->playSound(soundID);
+	if (m_controller != nullptr)
+		m_controller->playSound(soundID);
+}
+
+void GameWorld::setGameStatText(const string& text)
+{
+	if (m_controller != nullptr)
+		m_controller->setGameStatText(text.c_str());
 }
 
-void GameWorld::setGameStatText(string text)
+void GameWorld::setGameStatText(const char* text)
 {
-	m_controller->setGameStatText(text);
+	if (m_controller != nullptr)
+		m_controller->setGameStatText(text);
 }
 
 void GameWorld::setMsPerTick(int ms_per_tick)
 {
-	m_controller->setMsPerTick(ms_per_tick);
+	if (m_controller != nullptr)
+		m_controller->setMsPerTick(ms_per_tick);
+}
+
+void GameWorld::getVisibleObjects(int, int, int, int, vector<GraphObject*>& objects)
+{
+	for (int i = 0; i < GraphObject::NUM_DEPTHS; i++)
+	{
+		set<GraphObject*>& graphObjects = GraphObject::getGraphObjects(i);
+		objects.insert(objects.end(), graphObjects.begin(), graphObjects.end());
+	}
 }
@@ -3,10 +3,12 @@
 
 #include "GameConstants.h"
 #include <string>
+#include <vector>
 
 const int START_PLAYER_LIVES = 3;
 
 class GameController;
+class GraphObject;
 
 class GameWorld
 {
@@ -14,7 +16,8 @@ public:
 
 	GameWorld(std::string assetPath)
 	 : m_lives(START_PLAYER_LIVES), m_score(0), m_level(1),
-	   m_controller(nullptr), m_assetPath(assetPath)
+	   m_cameraX(0), m_cameraY(0), m_controller(nullptr), m_pendingKey(NO_KEY),
+	   m_assetPath(assetPath)
 	{
 	}
 
@@ -26,7 +29,8 @@ public:
 	virtual int move() = 0;
 	virtual void cleanUp() = 0;
 
-	void setGameStatText(std::string text);
+	void setGameStatText(const std::string& text);
+	void setGameStatText(const char* text);
 
 	bool getKey(int& value);
 	void playSound(int soundID);
@@ -61,6 +65,13 @@ public:
 		m_score += howMuch;
 	}
 
+	  // bottom-left corner of the part of the level that is on screen
+	void setCameraOrigin(int x, int y)
+	{
+		m_cameraX = x;
+		m_cameraY = y;
+	}
+
 	  // The following should be used by only the framework, not the student
 
 	bool isGameOver() const
@@ -72,24 +83,61 @@ public:
 	{
 		++m_level;
 	}
+
+	  // Back to how a new game starts (all lives, no score), but on the given
+	  // level, so a headless world can be played over and over.
+	void restartGame(int level)
+	{
+		m_lives = START_PLAYER_LIVES;
+		m_score = 0;
+		m_level = level;
+	}
  
 	void setController(GameController* controller)
 	{
 		m_controller = controller;
 	}
 
+	  // A world that never gets a controller runs headless: there's nothing to
+	  // draw or play, and its keys come from here instead of the keyboard.
+	  // Like the keyboard, only the last key pressed before getKey is kept.
+	void pressKey(int value)
+	{
+		m_pendingKey = value;
+	}
+
 	std::string assetPath() const
 	{
 		return m_assetPath;
 	}
 
+	int getCameraX() const
+	{
+		return m_cameraX;
+	}
+
+	int getCameraY() const
+	{
+		return m_cameraY;
+	}
+
+	  // Collects every graph object that may overlap the box [x1, x2] x [y1, y2] (in game
+	  // coordinates).  By default that is every graph object that exists, as long as
+	  // GraphObject tracking is on (it is once a controller runs the game).
+	virtual void getVisibleObjects(int x1, int y1, int x2, int y2, std::vector<GraphObject*>& objects);
+
 	void setMsPerTick(int ms_per_tick);
 private:
 	int				m_lives;
 	int				m_score;
 	int				m_level;
+	int				m_cameraX;
+	int				m_cameraY;
 	GameController* m_controller;
+	int				m_pendingKey;
 	std::string		m_assetPath;
+
+	static const int NO_KEY = -1;
 };
 
 #endif // GAMEWORLD_H_
@@ -3,6 +3,7 @@
 
 #include "SpriteManager.h"
 #include "GameConstants.h"
+#include "Metrics.h"
 
 #include <set>
 #include <cmath>
@@ -19,20 +20,31 @@ class GraphObject
 	static const int down = 270;
 
 	GraphObject(int imageID, int startX, int startY, int dir = 0, int depth = 0, double size = 1.0)
-	 : m_imageID(imageID), m_visible(true), m_x(startX), m_y(startY),
-	   m_destX(startX), m_destY(startY), m_brightness(1.0),
-	   m_animationNumber(0), m_direction(dir), m_depth(depth), m_size(size)
+	 : m_x(static_cast<float>(startX)), m_y(static_cast<float>(startY)),
+	   m_destX(startX), m_destY(startY), m_animationNumber(0), m_brightness(1.0f),
+	   m_size(static_cast<float>(size)), m_imageID(static_cast<short>(imageID)),
+	   m_direction(0), m_depth(static_cast<unsigned char>(depth)), m_visible(true),
+	   m_tracked(isTracking())
 	{
 		if (m_size <= 0)
 			m_size = 1;
+		setDirection(dir);
 
-		getGraphObjects(m_depth).insert(this);
+		if (m_tracked)
+		{
+			getGraphObjects(m_depth).insert(this);
+			Metrics::objectCreated(imageID);
+		}
 		setVisible(true);
 	}
 
 	virtual ~GraphObject()
 	{
-		getGraphObjects(m_depth).erase(this);
+		if (m_tracked)
+		{
+			getGraphObjects(m_depth).erase(this);
+			Metrics::objectDestroyed(m_imageID);
+		}
 	}
 
 	void setVisible(bool shouldIDisplay)
@@ -42,22 +54,24 @@ class GraphObject
 
 	void setBrightness(double brightness)
 	{
-		m_brightness = brightness;
+		m_brightness = static_cast<float>(brightness);
 	}
 
-	double getX() const
+	  // The simulation works in whole pixels; only the location used for drawing
+	  // (see getAnimationLocation) is kept as a float.
+	int getX() const
 	{
 		  // If already moved but not yet animated, use new location anyway.
 		return m_destX;
 	}
 
-	double getY() const
+	int getY() const
 	{
 		  // If already moved but not yet animated, use new location anyway.
 		return m_destY;
 	}
 
-	virtual void moveTo(double x, double y)
+	virtual void moveTo(int x, int y)
 	{
 		m_destX = x;
 		m_destY = y;
@@ -69,7 +83,7 @@ class GraphObject
 		double newX;
 		double newY;
 		getPositionInThisDirection(angle, units, newX, newY);
-		moveTo(newX, newY);
+		moveTo(static_cast<int>(std::lround(newX)), static_cast<int>(std::lround(newY)));
 		increaseAnimationNumber();
 	}
 
@@ -95,12 +109,12 @@ class GraphObject
 		while (d < 0)
 			d += 360;
 
-		m_direction = d % 360;
+		m_direction = static_cast<short>(d % 360);
 	}
 
 	void setSize(double size)
 	{
-		m_size = size;
+		m_size = static_cast<float>(size);
 	}
 
 	double getSize() const
@@ -116,6 +130,8 @@ class GraphObject
 
 	  // The following should be used by only the framework, not the student
 
+	static const int NUM_DEPTHS = 4;
+
 	bool isVisible() const
 	{
 		return m_visible;
@@ -139,8 +155,8 @@ class GraphObject
 
 	void animate()
 	{
-		m_x = m_destX;
-		m_y = m_destY;
+		m_x = static_cast<float>(m_destX);
+		m_y = static_cast<float>(m_destY);
 //		moveALittle(m_x, m_destX);
 	//	moveALittle(m_y, m_destY);
 	}
@@ -154,6 +170,22 @@ class GraphObject
 			return graphObjects[0];		// empty;
 	}
 
+	  // Whether objects created from now on go into the sets above and the
+	  // live object counts in Metrics.  Only the framework's drawing fallback,
+	  // its leak report and the metrics publisher look at them, so the
+	  // controller turns this on and headless worlds leave it off: that saves a
+	  // set node per object, and lets worlds on different threads (see
+	  // WorldBatch) create and destroy objects without sharing anything.
+	static void setTracking(bool track)
+	{
+		trackingFlag() = track;
+	}
+
+	static bool isTracking()
+	{
+		return trackingFlag();
+	}
+
 	void increaseAnimationNumber()
 	{
 		m_animationNumber++;
@@ -162,32 +194,46 @@ class GraphObject
 
   private:
 	friend class GameController;
+	friend class StudentWorld;  // for drawing observations without a window
 	int getID() const
 	{
 		return m_imageID;
 	}
 
+	int getDepth() const
+	{
+		return m_depth;
+	}
+
   private:
 	  // Prevent copying or assigning GraphObjects
 	GraphObject(const GraphObject&);
 	GraphObject& operator=(const GraphObject&);
 
-	static const int NUM_DEPTHS = 4;
-	int		m_imageID;
-	bool	m_visible;
-	double	m_x;
-	double	m_y;
-	double	m_destX;
-	double	m_destY;
-	double	m_brightness;
-	int     m_animationNumber;
-	int     m_direction;
-	int		m_depth;
-	double	m_size;
-
-	void moveALittle(double& from, double& to)
-	{
-		static const double DISTANCE = 1.0/ANIMATION_POSITIONS_PER_TICK;
+	  // Ordered by size with the small types at the end, so that the derived
+	  // actor classes can pack their own members into the tail.
+	float	m_x;
+	float	m_y;
+	int		m_destX;
+	int		m_destY;
+	int		m_animationNumber;
+	float	m_brightness;
+	float	m_size;
+	short	m_imageID;
+	short	m_direction;
+	unsigned char m_depth;
+	bool	m_visible : 1;
+	bool	m_tracked : 1;  // in getGraphObjects(m_depth) and counted in Metrics
+
+	static bool& trackingFlag()
+	{
+		static bool tracking = false;
+		return tracking;
+	}
+
+	void moveALittle(float& from, float& to)
+	{
+		static const float DISTANCE = 1.0f/ANIMATION_POSITIONS_PER_TICK;
 		if (to - from >= DISTANCE)
 			from += DISTANCE;
 		else if (from - to >= DISTANCE)
@@ -5,6 +5,7 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <vector>
 #include <cctype>
 
 class Level
@@ -19,92 +20,200 @@ public:
 	};
 
 	Level(std::string assetPath)
-	 : m_pathPrefix(assetPath)
+	 : m_width(0), m_height(0), m_peachX(-1), m_peachY(-1), m_pathPrefix(assetPath)
 	{
-		for (int i = 0; i < GRID_HEIGHT; i++)
-			for (int j = 0; j < GRID_WIDTH; j++)
-				m_grid[i][j] = empty;
-
 		if (!m_pathPrefix.empty())
 			m_pathPrefix += '/';
 	}
 
+	  // Reads and checks the whole level, keeping the grid in memory.
+
 	LoadResult loadLevel(std::string filename)
 	{
-		std::ifstream levelFile(m_pathPrefix + filename);
+		LoadResult result = openLevel(filename);
+		if (result != load_success)
+			return result;
+		if (!loadColumns(0, m_width, m_grid))
+			return load_fail_bad_format;
+		return load_success;
+	}
+
+	  // Checks the level in a single pass over the file and remembers where each row starts, but
+	  // doesn't keep the grid around; use loadColumns to read parts of it afterwards.
+
+	LoadResult openLevel(std::string filename)
+	{
+		m_fileName = m_pathPrefix + filename;
+		m_grid.clear();
+		m_rowOffsets.clear();
+		m_width = m_height = 0;
+		m_peachX = m_peachY = -1;
+
+		  // binary mode so that we can seek straight to a column later on
+		std::ifstream levelFile(m_fileName, std::ios::in | std::ios::binary);
 		if (!levelFile)
 			return load_fail_file_not_found;
 
-		  // get the grid
+		  // the grid ends at the first blank line (or the end of the file), and the first
+		  // row sets the width that every other row must match
 
 		std::string line;
 		int numPeach = 0;
 		int numMario = 0;
 		bool foundFlag = false;
+		bool lastRowAllBlocks = false;
+		int peachRow = -1;
 
-		for (int gy = GRID_HEIGHT-1; std::getline(levelFile, line); gy--)
+		for (std::streamoff offset = levelFile.tellg(); std::getline(levelFile, line); offset = levelFile.tellg())
 		{
-			if (gy < 0)	// too many grid lines?
+			size_t end = line.find_last_not_of(" \t\r");
+			if (end == std::string::npos)
 			{
-				if (line.find_first_not_of(" \t\r") != std::string::npos)
-					return load_fail_bad_format;  // non-blank line
 				char dummy;
 				if (levelFile >> dummy)  // non-blank rest of file
 					return load_fail_bad_format;
 				break;
 			}
-			if (line.size() < GRID_WIDTH  ||
-					line.find_first_not_of(" \t\r", GRID_WIDTH) != std::string::npos)
+			int width = static_cast<int>(end + 1);
+			if (m_rowOffsets.empty())
+				m_width = width;
+			else if (width != m_width)
 				return load_fail_bad_format;
-			for (int gx = 0; gx < GRID_WIDTH; gx++)
+
+			bool allBlocks = true;
+			for (int gx = 0; gx < m_width; gx++)
 			{
 				GridEntry ge;
-				switch (toupper(line[gx]))
+				if (!toGridEntry(line[gx], ge))
+					return load_fail_bad_format;
+				switch (ge)
 				{
-					default:	return load_fail_bad_format;
-					case ' ':	ge = empty; break;
-					case '@':	ge = peach; numPeach++; break;
-					case 'G':	ge = goomba; break;
-					case 'K':	ge = koopa; break;
-					case 'P':	ge = piranha; break;
-					case '#':	ge = block; break;
-					case '*':	ge = star_goodie_block; break;
-					case '^':	ge = mushroom_goodie_block; break;
-					case '%':	ge = flower_goodie_block; break;
-					case 'I':	ge = pipe; break;
-					case 'F':	ge = flag; foundFlag = true; break;
-					case 'M':	ge = mario; numMario++; break;
+					default:	break;
+					case peach:	numPeach++; m_peachX = gx; peachRow = static_cast<int>(m_rowOffsets.size()); break;
+					case flag:	foundFlag = true; break;
+					case mario:	numMario++; break;
 				}
-				m_grid[gy][gx] = ge;
+				if (ge != block)
+					allBlocks = false;
 			}
+
+			  // edges must be blocks
+			if (toupper(line[0]) != '#'  ||  toupper(line[m_width-1]) != '#')
+				return load_fail_bad_format;
+			if (m_rowOffsets.empty()  &&  !allBlocks)
+				return load_fail_bad_format;
+			lastRowAllBlocks = allBlocks;
+
+			m_rowOffsets.push_back(offset);
 		}
+		if (m_rowOffsets.empty()  ||  !lastRowAllBlocks)
+			return load_fail_bad_format;
 		if (numPeach != 1  ||  numMario > 1  ||  (numMario == 1) == foundFlag)
 			return load_fail_bad_format;
 
-		  // edges must be blocks
+		m_height = static_cast<int>(m_rowOffsets.size());
+		m_peachY = m_height - 1 - peachRow;
+		return load_success;
+	}
 
-		for (int gy = 0; gy < GRID_HEIGHT; gy++)
-			if (m_grid[gy][0] != block  ||  m_grid[gy][GRID_WIDTH-1] != block)
-				return load_fail_bad_format;
+	  // Reads columns [firstCol, firstCol + numCols) of an opened level into grid, indexed by
+	  // [gy * numCols + (gx - firstCol)].  If loadLevel kept the whole grid they're copied out of
+	  // it, otherwise they're read from disk.  Either way the level doesn't change, so it is safe
+	  // to call from any number of threads while the level is in use.
 
-		for (int gx = 0; gx < GRID_WIDTH; gx++)
-			if (m_grid[0][gx] != block  ||  m_grid[GRID_HEIGHT-1][gx] != block)
-				return load_fail_bad_format;
+	bool loadColumns(int firstCol, int numCols, std::vector<GridEntry>& grid) const
+	{
+		if (firstCol < 0  ||  numCols < 0  ||  firstCol + numCols > m_width)
+			return false;
+		if (!m_grid.empty())
+		{
+			grid.resize(numCols * m_height);
+			for (int gy = 0; gy < m_height; gy++)
+				for (int c = 0; c < numCols; c++)
+					grid[gy * numCols + c] = m_grid[gy * m_width + firstCol + c];
+			return true;
+		}
+		std::ifstream levelFile(m_fileName, std::ios::in | std::ios::binary);
+		if (!levelFile)
+			return false;
 
-		return load_success;
+		grid.assign(numCols * m_height, empty);
+		std::string row(numCols, ' ');
+		for (int r = 0; r < m_height; r++)
+		{
+			levelFile.seekg(m_rowOffsets[r] + firstCol);
+			if (numCols > 0  &&  !levelFile.read(&row[0], numCols))
+				return false;
+			int gy = m_height - 1 - r;
+			for (int c = 0; c < numCols; c++)
+				if (!toGridEntry(row[c], grid[gy * numCols + c]))
+					return false;
+		}
+		return true;
 	}
 
-	GridEntry getContentsOf(int gx, int gy)
+	GridEntry getContentsOf(int gx, int gy) const
 	{
-		if (gx < 0  ||  gx >= GRID_WIDTH  ||  gy < 0  ||  gy >= GRID_HEIGHT)
+		if (gx < 0  ||  gx >= m_width  ||  gy < 0  ||  gy >= m_height  ||  m_grid.empty())
 			return empty;
 
-		return m_grid[gy][gx];
+		return m_grid[gy * m_width + gx];
+	}
+
+	  // size of the level in grid cells
+
+	int getWidth() const
+	{
+		return m_width;
+	}
+
+	int getHeight() const
+	{
+		return m_height;
+	}
+
+	  // where peach starts, in grid cells
+
+	int getPeachX() const
+	{
+		return m_peachX;
+	}
+
+	int getPeachY() const
+	{
+		return m_peachY;
 	}
 
 private:
-	GridEntry   m_grid[GRID_HEIGHT][GRID_WIDTH];  // indexed by [gy][gx]
+	std::vector<GridEntry> m_grid;  // indexed by [gy * m_width + gx], only filled in by loadLevel
+	std::vector<std::streamoff> m_rowOffsets;  // where each row starts in the file, top row first
+	int         m_width;
+	int         m_height;
+	int         m_peachX;
+	int         m_peachY;
 	std::string m_pathPrefix;
+	std::string m_fileName;
+
+	static bool toGridEntry(char c, GridEntry& ge)
+	{
+		switch (toupper(c))
+		{
+			default:	return false;
+			case ' ':	ge = empty; break;
+			case '@':	ge = peach; break;
+			case 'G':	ge = goomba; break;
+			case 'K':	ge = koopa; break;
+			case 'P':	ge = piranha; break;
+			case '#':	ge = block; break;
+			case '*':	ge = star_goodie_block; break;
+			case '^':	ge = mushroom_goodie_block; break;
+			case '%':	ge = flower_goodie_block; break;
+			case 'I':	ge = pipe; break;
+			case 'F':	ge = flag; break;
+			case 'M':	ge = mario; break;
+		}
+		return true;
+	}
 };
 
 #endif // LEVEL_H_
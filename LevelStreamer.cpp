@@ -0,0 +1,87 @@
+#include "LevelStreamer.h"
+#include "Trace.h"
+#include <algorithm>
+using namespace std;
+
+LevelStreamer::LevelStreamer(const Level& level)
+	: m_level(level), m_reading(-1), m_quit(false) {
+	m_thread = thread(&LevelStreamer::run, this);
+}
+
+LevelStreamer::~LevelStreamer() {
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_quit = true;
+	}
+	m_changed.notify_all();
+	m_thread.join();
+}
+
+int LevelStreamer::chunkColumns(const Level& level, int chunk) {
+	int remaining = level.getWidth() - chunk * CHUNK_WIDTH;
+	return remaining < CHUNK_WIDTH ? remaining : CHUNK_WIDTH;
+}
+
+void LevelStreamer::request(int chunk) {
+	{
+		lock_guard<mutex> lock(m_mutex);
+		if (chunk == m_reading || m_ready.count(chunk) || find(m_pending.begin(), m_pending.end(), chunk) != m_pending.end())
+			return; // already on its way
+		m_pending.push_back(chunk);
+	}
+	m_changed.notify_all();
+}
+
+bool LevelStreamer::take(int chunk, vector<Level::GridEntry>& grid, bool wait) {
+	unique_lock<mutex> lock(m_mutex);
+	if (wait) {
+		// if the background thread is in the middle of it, just wait for it to finish
+		m_changed.wait(lock, [&] { return m_reading != chunk; });
+	}
+	map<int, vector<Level::GridEntry>>::iterator it = m_ready.find(chunk);
+	if (it != m_ready.end()) {
+		grid.swap(it->second);
+		m_ready.erase(it);
+		return true;
+	}
+	if (!wait)
+		return false;
+
+	// nobody has read it yet, so take it off the queue and read it ourselves
+	deque<int>::iterator pending = find(m_pending.begin(), m_pending.end(), chunk);
+	if (pending != m_pending.end())
+		m_pending.erase(pending);
+	lock.unlock();
+	return read(chunk, grid);
+}
+
+void LevelStreamer::run() {
+	Trace::nameThread("level streamer");
+	unique_lock<mutex> lock(m_mutex);
+	for (;;) {
+		m_changed.wait(lock, [&] { return m_quit || !m_pending.empty(); });
+		if (m_quit)
+			return;
+		int chunk = m_pending.front();
+		m_pending.pop_front();
+		m_reading = chunk;
+
+		// don't hold the lock while we're on the disk
+		lock.unlock();
+		vector<Level::GridEntry> grid;
+		bool ok = read(chunk, grid);
+		lock.lock();
+
+		if (ok)
+			m_ready[chunk].swap(grid);
+		m_reading = -1;
+		m_changed.notify_all();
+	}
+}
+
+bool LevelStreamer::read(int chunk, vector<Level::GridEntry>& grid) const {
+	if (chunk < 0 || chunk >= numChunks())
+		return false;
+	Trace::Scope span("read chunk");
+	return m_level.loadColumns(chunk * CHUNK_WIDTH, chunkColumns(chunk), grid);
+}
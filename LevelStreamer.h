@@ -0,0 +1,52 @@
+#ifndef LEVELSTREAMER_H_
+#define LEVELSTREAMER_H_
+
+#include "Level.h"
+#include "GameConstants.h"
+#include <vector>
+#include <deque>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Splits an opened level into fixed-width chunks of columns and reads them from disk on a background thread,
+// so big levels only ever have a few chunks in memory. The streamer just reads and parses the grid; spawning
+// actors out of a chunk is up to whoever take()s it.
+
+class LevelStreamer {
+public:
+	static const int CHUNK_WIDTH = GRID_WIDTH; // columns per chunk
+
+	LevelStreamer(const Level& level); // the level has to be opened already and outlive the streamer
+	~LevelStreamer();
+	int numChunks() const { return numChunks(m_level); }
+	int chunkColumns(int chunk) const { return chunkColumns(m_level, chunk); } // the last chunk can be narrower than the rest
+	// the same for any level, for splitting one up into chunks without streaming it
+	static int numChunks(const Level& level) { return (level.getWidth() + CHUNK_WIDTH - 1) / CHUNK_WIDTH; }
+	static int chunkColumns(const Level& level, int chunk);
+	void request(int chunk); // queue a chunk to be read in the background, does nothing if it's already on its way
+
+	// hands back a chunk indexed by [gy * chunkColumns(chunk) + column]. if it hasn't been read yet, we either read it
+	// right now (wait == true) or just return false
+	bool take(int chunk, std::vector<Level::GridEntry>& grid, bool wait);
+
+private:
+	const Level& m_level;
+	std::thread m_thread;
+	std::mutex m_mutex;
+	std::condition_variable m_changed;
+	std::deque<int> m_pending; // chunks requested but not started yet
+	std::map<int, std::vector<Level::GridEntry>> m_ready; // chunks read but not taken yet
+	int m_reading; // chunk the background thread is reading right now, or -1
+	bool m_quit;
+
+	void run();
+	bool read(int chunk, std::vector<Level::GridEntry>& grid) const;
+
+	// no copying
+	LevelStreamer(const LevelStreamer&);
+	LevelStreamer& operator=(const LevelStreamer&);
+};
+
+#endif // LEVELSTREAMER_H_
@@ -0,0 +1,123 @@
+// Reports how much memory the actors take: the size of every actor class, and for every level
+// in a directory how many of each actor it starts with and how many bytes they come to.
+//
+//   MemoryReport [assetDirectory]
+//
+// By default it reads the levels in Assets/. The objects themselves, their spatial index entries
+// and their node in GraphObject's registry of live objects are counted, but not the heap's own
+// overhead per allocation. The registry only gets filled while a GameController runs the game
+// (see GraphObject::setTracking), so every level also gets a total without it for headless worlds.
+
+#include "Actor.h"
+#include "Level.h"
+#include <cstdio>
+#include <sstream>
+#include <string>
+using namespace std;
+
+struct ActorType
+{
+	const char* name;
+	size_t size;
+};
+
+  // what each kind of grid entry turns into; peach is created separately but she's in the level once
+static const ActorType gridTypes[] = {
+	{ "empty", 0 },
+	{ "Peach", sizeof(Peach) },
+	{ "Koopa", sizeof(Koopa) },
+	{ "Goomba", sizeof(Goomba) },
+	{ "Piranha", sizeof(Piranha) },
+	{ "Block", sizeof(Block) },
+	{ "Block (star)", sizeof(Block) },
+	{ "Block (mushroom)", sizeof(Block) },
+	{ "Block (flower)", sizeof(Block) },
+	{ "Pipe", sizeof(Pipe) },
+	{ "Flag", sizeof(Flag) },
+	{ "Mario", sizeof(Mario) },
+};
+
+  // things that only show up while playing
+static const ActorType spawnedTypes[] = {
+	{ "Mushroom", sizeof(Mushroom) },
+	{ "Flower", sizeof(Flower) },
+	{ "Star", sizeof(Star) },
+	{ "PiranhaFireball", sizeof(PiranhaFireball) },
+	{ "PeachFireball", sizeof(PeachFireball) },
+	{ "Shell", sizeof(Shell) },
+};
+
+  // every actor also has its pointer and position packed into a spatial index cell
+static const size_t INDEX_ENTRY = sizeof(Actor*) + 2 * sizeof(int);
+
+  // and, when tracked, a node in a std::set<GraphObject*>: three links and a color padded out to
+  // a pointer, then the pointer itself (the same in libstdc++, libc++ and MSVC's library)
+static const size_t REGISTRY_NODE = 4 * sizeof(void*) + sizeof(GraphObject*);
+
+static string levelName(int level)
+{
+	ostringstream oss;
+	oss << "level" << (level < 10 ? "0" : "") << level << ".txt";
+	return oss.str();
+}
+
+int main(int argc, char* argv[])
+{
+	string dir = (argc > 1 ? argv[1] : "Assets");
+
+	printf("%-18s %6s\n", "class", "bytes");
+	printf("%-18s %6zu\n", "GraphObject", sizeof(GraphObject));
+	printf("%-18s %6zu\n", "Actor", sizeof(Actor));
+	const int numGridTypes = sizeof(gridTypes) / sizeof(gridTypes[0]);
+	for (int t = 1; t < numGridTypes; t++)
+		if (t < Level::star_goodie_block  ||  t > Level::flower_goodie_block)
+			printf("%-18s %6zu\n", gridTypes[t].name, gridTypes[t].size);
+	for (size_t t = 0; t < sizeof(spawnedTypes) / sizeof(spawnedTypes[0]); t++)
+		printf("%-18s %6zu\n", spawnedTypes[t].name, spawnedTypes[t].size);
+	printf("%-18s %6zu\n", "(index entry)", INDEX_ENTRY);
+	printf("%-18s %6zu\n", "(registry node)", REGISTRY_NODE);
+
+	int levelsFound = 0;
+	for (int level = 1; level <= 99; level++)
+	{
+		Level lev(dir);
+		string name = levelName(level);
+		Level::LoadResult result = lev.loadLevel(name);
+		if (result == Level::load_fail_file_not_found)
+			continue;
+		levelsFound++;
+		if (result != Level::load_success)
+		{
+			printf("\n%s: bad format\n", name.c_str());
+			continue;
+		}
+
+		int counts[numGridTypes] = {};
+		for (int y = 0; y < lev.getHeight(); y++)
+			for (int x = 0; x < lev.getWidth(); x++)
+				counts[lev.getContentsOf(x, y)]++;
+
+		printf("\n%s (%d x %d)\n", name.c_str(), lev.getWidth(), lev.getHeight());
+		printf("%-18s %6s %10s\n", "actor", "count", "bytes");
+		int totalCount = 0;
+		size_t totalBytes = 0;
+		for (int t = 1; t < numGridTypes; t++)
+		{
+			if (counts[t] == 0)
+				continue;
+			size_t bytes = counts[t] * (gridTypes[t].size + INDEX_ENTRY + REGISTRY_NODE);
+			printf("%-18s %6d %10zu\n", gridTypes[t].name, counts[t], bytes);
+			totalCount += counts[t];
+			totalBytes += bytes;
+		}
+		printf("%-18s %6d %10zu\n", "total", totalCount, totalBytes);
+		printf("%-18s %6d %10zu\n", "total (headless)", totalCount, totalBytes - totalCount * REGISTRY_NODE);
+	}
+
+	if (levelsFound == 0)
+	{
+		cerr << "No levels found in " << dir << endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,199 @@
+#include "Metrics.h"
+#include "GameConstants.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+using namespace std;
+
+#ifndef _WIN32
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+// zero-initialized statics, so counting works from the first object on
+atomic<unsigned long long> Metrics::s_ticks;
+atomic<unsigned long long> Metrics::s_sounds;
+atomic<unsigned long long> Metrics::s_frames[Metrics::FRAME_BUCKETS + 1];
+atomic<int> Metrics::s_objects[Metrics::NUM_IMAGE_IDS];
+atomic<const char*> Metrics::s_state;
+
+static const char* const imageNames[Metrics::NUM_IMAGE_IDS] = {
+	"peach", "koopa", "goomba", "shell", "piranha", "mario", "block",
+	"pipe", "star", "flower", "mushroom", "flag", "piranha_fire", "peach_fire"
+};
+
+// only ever touched from the thread that draws
+static chrono::steady_clock::time_point lastFrame;
+static bool drewFrame = false;
+
+void Metrics::frame() {
+	chrono::steady_clock::time_point now = chrono::steady_clock::now();
+	long long us = chrono::duration_cast<chrono::microseconds>(now - lastFrame).count();
+	// a gap of over a second means we were sitting at a prompt, not that a frame took that long
+	if (drewFrame && us < 1000000) {
+		long long bucket = us / FRAME_BUCKET_US;
+		s_frames[bucket < FRAME_BUCKETS ? bucket : FRAME_BUCKETS].fetch_add(1, memory_order_relaxed);
+	}
+	lastFrame = now;
+	drewFrame = true;
+}
+
+#ifdef _WIN32
+
+bool Metrics::startPublisher(const char*) {
+	cerr << "Publishing metrics needs Unix domain sockets, which this build doesn't have" << endl;
+	return false;
+}
+
+void Metrics::stopPublisher() {
+}
+
+#else
+
+// what the publisher thread reads the counters into every second
+struct MetricsSample {
+	chrono::steady_clock::time_point time;
+	unsigned long long ticks, sounds;
+	unsigned long long frames[Metrics::FRAME_BUCKETS + 1];
+};
+
+static thread publisher;
+static atomic<bool> quitPublishing(false);
+static int listener = -1;
+static string socketFile;
+
+// the frame time in ms that fraction of the frames in counts were at most, from the top of its bucket
+static double framePercentile(const unsigned long long* counts, unsigned long long total, double fraction) {
+	unsigned long long seen = 0;
+	for (int b = 0; b < Metrics::FRAME_BUCKETS; b++) {
+		seen += counts[b];
+		if (seen >= fraction * total)
+			return (b + 1) * Metrics::FRAME_BUCKET_US / 1000.0;
+	}
+	return Metrics::FRAME_BUCKETS * Metrics::FRAME_BUCKET_US / 1000.0; // reads as "this long or longer"
+}
+
+bool Metrics::startPublisher(const char* socketPath) {
+	sockaddr_un address = {};
+	address.sun_family = AF_UNIX;
+	if (strlen(socketPath) >= sizeof(address.sun_path)) {
+		cerr << "Metrics socket path " << socketPath << " is too long" << endl;
+		return false;
+	}
+	strcpy(address.sun_path, socketPath);
+
+	listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listener < 0) {
+		cerr << "Cannot create the metrics socket" << endl;
+		return false;
+	}
+	unlink(socketPath); // left over from a run that didn't get to clean up
+	if (bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listener, 4) != 0) {
+		cerr << "Cannot listen for metrics on " << socketPath << endl;
+		close(listener);
+		listener = -1;
+		return false;
+	}
+	socketFile = socketPath;
+	quitPublishing = false;
+
+	publisher = thread([] {
+		auto takeSample = [](MetricsSample& sample) {
+			sample.time = chrono::steady_clock::now();
+			sample.ticks = s_ticks.load(memory_order_relaxed);
+			sample.sounds = s_sounds.load(memory_order_relaxed);
+			for (int b = 0; b <= FRAME_BUCKETS; b++)
+				sample.frames[b] = s_frames[b].load(memory_order_relaxed);
+		};
+		MetricsSample previous, current;
+		takeSample(previous);
+		const chrono::steady_clock::time_point started = previous.time;
+		string snapshot = "starting\n";
+
+		while (!quitPublishing) {
+			pollfd pfd = { listener, POLLIN, 0 };
+			if (poll(&pfd, 1, 100) > 0 && (pfd.revents & POLLIN) != 0) {
+				int client = accept(listener, nullptr, nullptr);
+				if (client >= 0) {
+					timeval timeout = { 0, 100000 }; // nobody gets to hold us up for long
+					setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+#ifdef SO_NOSIGPIPE
+					int on = 1;
+					setsockopt(client, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+#ifdef MSG_NOSIGNAL
+					const int flags = MSG_NOSIGNAL; // a client hanging up early mustn't kill the game with SIGPIPE
+#else
+					const int flags = 0;
+#endif
+					send(client, snapshot.data(), snapshot.size(), flags);
+					close(client);
+				}
+			}
+
+			if (chrono::steady_clock::now() - previous.time < chrono::seconds(1))
+				continue;
+			takeSample(current);
+			double seconds = chrono::duration<double>(current.time - previous.time).count();
+			unsigned long long frameCounts[FRAME_BUCKETS + 1];
+			unsigned long long numFrames = 0;
+			for (int b = 0; b <= FRAME_BUCKETS; b++) {
+				frameCounts[b] = current.frames[b] - previous.frames[b];
+				numFrames += frameCounts[b];
+			}
+
+			char line[128];
+			const char* state = s_state.load(memory_order_relaxed);
+			snapshot = "state ";
+			snapshot += (state != nullptr ? state : "none");
+			snapshot += '\n';
+			snprintf(line, sizeof(line), "uptime_s %.1f\nticks %llu\nticks_per_s %.1f\nframes_per_s %.1f\n",
+					 chrono::duration<double>(current.time - started).count(), current.ticks,
+					 (current.ticks - previous.ticks) / seconds, numFrames / seconds);
+			snapshot += line;
+			if (numFrames > 0) {
+				snprintf(line, sizeof(line), "frame_ms_p50 %.2f\nframe_ms_p90 %.2f\nframe_ms_p99 %.2f\nframe_ms_max %.2f\n",
+						 framePercentile(frameCounts, numFrames, 0.5), framePercentile(frameCounts, numFrames, 0.9),
+						 framePercentile(frameCounts, numFrames, 0.99), framePercentile(frameCounts, numFrames, 1));
+				snapshot += line;
+			}
+			snprintf(line, sizeof(line), "sounds %llu\nsounds_per_s %.1f\n", current.sounds,
+					 (current.sounds - previous.sounds) / seconds);
+			snapshot += line;
+
+			int total = 0;
+			for (int id = 0; id < NUM_IMAGE_IDS; id++) {
+				int count = s_objects[id].load(memory_order_relaxed);
+				total += count;
+				snprintf(line, sizeof(line), "actors_%s %d\n", imageNames[id], count);
+				snapshot += line;
+			}
+			// what flies around and gets checked against everything in its way every tick
+			int projectiles = s_objects[IID_SHELL].load(memory_order_relaxed) + s_objects[IID_PIRANHA_FIRE].load(memory_order_relaxed) +
+							  s_objects[IID_PEACH_FIRE].load(memory_order_relaxed);
+			snprintf(line, sizeof(line), "actors %d\nprojectiles %d\n", total, projectiles);
+			snapshot += line;
+
+			previous = current;
+		}
+	});
+	return true;
+}
+
+void Metrics::stopPublisher() {
+	if (!publisher.joinable())
+		return;
+	quitPublishing = true;
+	publisher.join();
+	close(listener);
+	listener = -1;
+	unlink(socketFile.c_str());
+}
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef METRICS_H_
+#define METRICS_H_
+
+#include <atomic>
+
+// Counters the game bumps while it runs, and a publisher thread that turns them into a text snapshot once a second and
+// hands the latest one to whoever connects to a Unix domain socket (nc -U path prints it). All the game ever does here
+// is relaxed atomic adds and stores; the reading, diffing and formatting happen on the publisher thread. The game
+// publishes when run with SPS_METRICS=socketPath.
+
+class Metrics {
+public:
+	static const int NUM_IMAGE_IDS = 14;    // live objects are counted for image IDs below this
+	static const int FRAME_BUCKET_US = 250; // frame times are counted in steps this long
+	static const int FRAME_BUCKETS = 256;   // so up to 64 ms, with one more bucket for anything longer
+
+	static void tick() { s_ticks.fetch_add(1, std::memory_order_relaxed); }
+	static void frame(); // a frame was drawn; counts the time since the last one
+	static void soundPlayed() { s_sounds.fetch_add(1, std::memory_order_relaxed); }
+	static void setState(const char* state) { s_state.store(state, std::memory_order_relaxed); } // has to stay around
+
+	// every tracked GraphObject (see GraphObject::setTracking, so only when a controller runs the game) reports itself
+	// here, which is where the actor counts come from
+	static void objectCreated(int imageID) {
+		if (imageID >= 0 && imageID < NUM_IMAGE_IDS)
+			s_objects[imageID].fetch_add(1, std::memory_order_relaxed);
+	}
+	static void objectDestroyed(int imageID) {
+		if (imageID >= 0 && imageID < NUM_IMAGE_IDS)
+			s_objects[imageID].fetch_sub(1, std::memory_order_relaxed);
+	}
+
+	// starts the publisher thread listening on socketPath (replacing any stale socket file there). returns false if
+	// the socket can't be set up, or on platforms without Unix domain sockets
+	static bool startPublisher(const char* socketPath);
+	static void stopPublisher(); // and removes the socket file
+
+private:
+	static std::atomic<unsigned long long> s_ticks, s_sounds;
+	static std::atomic<unsigned long long> s_frames[FRAME_BUCKETS + 1];
+	static std::atomic<int> s_objects[NUM_IMAGE_IDS];
+	static std::atomic<const char*> s_state;
+};
+
+#endif // METRICS_H_
@@ -0,0 +1,474 @@
+// Replays recorded playthroughs headless and checks them against a stored baseline: each one
+// has to end up in exactly the same state as before, and must not have started allocating
+// more than the tolerance allows (or gotten slower, on a machine that has its own speed
+// baseline).
+//
+//   Regression [options] [playthrough ...]
+//
+//   --assets D       where the levels are (default Assets)
+//   --dir D          where the playthroughs, baseline.txt and speed.txt are (default Playthroughs)
+//   --tolerance P    how many percent slower / more allocations is still fine (default 20)
+//   --repeat N       run every playthrough N times and keep the fastest (default 5)
+//   --update         write this run's results as the new baselines instead of checking
+//
+// With no playthroughs it runs level01.rec, level02.rec and level03.rec.  Playthroughs are
+// recorded by running the game with SPS_RECORD=file (see GameController::recordKey).
+// baseline.txt has the state hashes and allocations, which are the same everywhere, and is
+// checked in.  Ticks per second depend on the machine, so they go in speed.txt, which isn't:
+// run with --update once (on a build known to be good) to make one, and until then the
+// speed check is skipped.
+// When allocations are counted, every playthrough also gets played twice more in one world,
+// and the second time peach, the other actors and their events must not allocate at all.
+// Before the playthroughs it runs scripted checks of things that only show up after a
+// particular sequence of moves (each with its own level in a directory under --dir), and
+// fails if one of them doesn't hold.
+// Exits with 1 if anything regressed.
+
+#include "StudentWorld.h"
+#include "GameConstants.h"
+#include "GraphObject.h"
+#include "AllocStats.h"
+#include "LevelStreamer.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+using namespace std;
+
+struct Playthrough
+{
+	string name;
+	unsigned int seed;
+	int level;                        // level the recording starts on
+	int ticks;                        // how many ticks it lasted, -1 if the file doesn't say
+	vector<pair<int, int> > keys;     // (tick, key), in tick order
+};
+
+struct Result
+{
+	unsigned long long hash;
+	int ticks;                        // ticks actually run (the game can end before the recording does)
+	double ticksPerSec;
+	double allocsPerTick;             // -1 if allocations aren't being counted
+};
+
+static bool loadPlaythrough(const string& path, Playthrough& p)
+{
+	ifstream in(path.c_str());
+	if (!in)
+		return false;
+	p.seed = 0;
+	p.level = 1;
+	p.ticks = -1;
+	p.keys.clear();
+	string line;
+	while (getline(in, line))
+	{
+		if (line.empty()  ||  line[0] == '#')
+			continue;
+		istringstream iss(line);
+		string first;
+		iss >> first;
+		if (first == "seed")
+			iss >> p.seed;
+		else if (first == "level")
+			iss >> p.level;
+		else if (first == "ticks")
+			iss >> p.ticks;
+		else
+		{
+			int key;
+			if (!(iss >> key))
+				return false;
+			p.keys.push_back(make_pair(atoi(first.c_str()), key));
+		}
+	}
+	if (p.ticks < 0)  // the game was killed before it could write how long it ran
+		p.ticks = p.keys.empty() ? 0 : p.keys.back().first + 1;
+	return true;
+}
+
+  // FNV-1a over every graph object's position, direction and visibility (sorted, since the
+  // object sets are ordered by address) and the score, lives, level and tick count.  main()
+  // turns on GraphObject tracking, like the game does, so every object is in the sets.
+
+static unsigned long long stateHash(const GameWorld& world, int ticks)
+{
+	vector<unsigned long long> objects;
+	for (int d = 0; d < GraphObject::NUM_DEPTHS; d++)
+	{
+		set<GraphObject*>& layer = GraphObject::getGraphObjects(d);
+		for (set<GraphObject*>::iterator it = layer.begin(); it != layer.end(); it++)
+		{
+			GraphObject* g = *it;
+			objects.push_back((static_cast<unsigned long long>(static_cast<unsigned int>(g->getX())) << 40) ^
+							  (static_cast<unsigned long long>(static_cast<unsigned int>(g->getY())) << 16) ^
+							  (g->getDirection() << 4) ^ (g->isVisible() << 3) ^ d);
+		}
+	}
+	sort(objects.begin(), objects.end());
+	objects.push_back(static_cast<unsigned int>(world.getScore()));
+	objects.push_back(static_cast<unsigned int>(world.getLives()));
+	objects.push_back(static_cast<unsigned int>(world.getLevel()));
+	objects.push_back(static_cast<unsigned int>(ticks));
+
+	unsigned long long hash = 14695981039346656037ULL;
+	for (size_t i = 0; i < objects.size(); i++)
+	{
+		for (int b = 0; b < 8; b++)
+		{
+			hash ^= (objects[i] >> (8 * b)) & 0xff;
+			hash *= 1099511628211ULL;
+		}
+	}
+	return hash;
+}
+
+  // Plays the playthrough's keys in a world that's on its first level, the way GameController
+  // would minus the prompts in between, and returns the last status.  ticks is how many got
+  // played (the game can end before the recording does).
+
+static int play(StudentWorld& world, const Playthrough& p, int& ticks)
+{
+	seedRandom(p.seed);
+	int status = world.init();
+	size_t nextKey = 0;
+	int t = 0;
+	while (t < p.ticks  &&  status == GWSTATUS_CONTINUE_GAME)
+	{
+		while (nextKey < p.keys.size()  &&  p.keys[nextKey].first < t)
+			nextKey++;
+		if (nextKey < p.keys.size()  &&  p.keys[nextKey].first == t)
+			world.pressKey(p.keys[nextKey].second);
+		status = world.move();
+		t++;
+		if (status == GWSTATUS_PLAYER_DIED  &&  !world.isGameOver())
+		{
+			world.cleanUp();
+			status = world.init();
+		}
+		else if (status == GWSTATUS_FINISHED_LEVEL)
+		{
+			world.advanceToNextLevel();
+			world.cleanUp();
+			status = world.init();
+		}
+	}
+	ticks = t;
+	return status;
+}
+
+  // Runs the playthrough in a world of its own, timing it and counting its allocations.
+
+static bool replay(const Playthrough& p, const string& assets, Result& result)
+{
+	StudentWorld world(assets);
+	world.restartGame(p.level);
+
+	AllocStats::Counts before, after;
+	AllocStats::read(before);
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	int t;
+	int status = play(world, p, t);
+
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	AllocStats::read(after);
+	if (status == GWSTATUS_LEVEL_ERROR)
+	{
+		cerr << p.name << ": can't load level " << world.getLevel() << " from " << assets << endl;
+		return false;
+	}
+
+	result.hash = stateHash(world, t);
+	result.ticks = t;
+	result.ticksPerSec = seconds > 0 ? t / seconds : 0;
+	result.allocsPerTick = -1;
+	if (AllocStats::enabled()  &&  t > 0)
+	{
+		unsigned long long allocs = 0;
+		for (int ph = 0; ph < AllocStats::NUM_PHASES; ph++)
+			allocs += after.allocs[ph] - before.allocs[ph];
+		result.allocsPerTick = static_cast<double>(allocs) / t;
+	}
+	world.cleanUp();
+	return true;
+}
+
+  // Plays the playthrough twice in the same world and returns how many times the second go
+  // allocated while peach, the other actors and their events were being handled.  The first
+  // go is the warm-up: whatever the world keeps around (the spatial index's cells, the actor
+  // pool, the event lists) grows as big as the playthrough ever needs, and the second go does
+  // exactly the same, so anything that still allocates does so every time it happens.
+  // Streaming and loading levels aren't counted (a chunk can get read from disk on the spot
+  // if the loader thread hasn't gotten to it), and GraphObject tracking is off like it is
+  // for any headless world, since its registry allocates for every object.
+
+static unsigned long long steadyStateAllocs(const Playthrough& p, const string& assets)
+{
+	bool tracking = GraphObject::isTracking();
+	GraphObject::setTracking(false);
+	StudentWorld world(assets);
+	AllocStats::Counts before, after;
+	int t;
+	for (int go = 0; go < 2; go++)
+	{
+		world.restartGame(p.level);
+		AllocStats::read(before);
+		play(world, p, t);
+		AllocStats::read(after);
+		world.cleanUp();
+	}
+	GraphObject::setTracking(tracking);
+	return after.allocs[AllocStats::peach] - before.allocs[AllocStats::peach] +
+		   after.allocs[AllocStats::actors] - before.allocs[AllocStats::actors] +
+		   after.allocs[AllocStats::events] - before.allocs[AllocStats::events];
+}
+
+  // Peach starts under a mushroom block in a level many chunks wide.  She bonks it, runs
+  // right until its chunk has been evicted, runs back and bonks it again: that second bonk
+  // has to find the block already empty.  Returns what went wrong, or "" if nothing did.
+
+static string checkEviction(const string& dir)
+{
+	StudentWorld world(dir + "/eviction");
+	seedRandom(1);
+	if (world.init() != GWSTATUS_CONTINUE_GAME)
+		return "can't load " + dir + "/eviction/level01.txt";
+	const int startX = world.getPeach()->getX();
+	const int evictedAt = 4 * LevelStreamer::CHUNK_WIDTH * SPRITE_WIDTH;  // well clear of chunk 0's reach
+
+	struct Step
+	{
+		int key;  // -1 for none
+		int ticks;
+	};
+	const Step script[] = {
+		{ KEY_PRESS_UP, 1 }, { -1, 20 }, { KEY_PRESS_RIGHT, 300 }, { KEY_PRESS_LEFT, 300 }, { KEY_PRESS_UP, 1 }, { -1, 20 }
+	};
+	int mushrooms = 0, hits = 0, farthest = startX;
+	for (size_t n = 0; n < sizeof(script) / sizeof(script[0]); n++)
+	{
+		for (int t = 0; t < script[n].ticks; t++)
+		{
+			if (script[n].key >= 0)
+				world.pressKey(script[n].key);
+			if (world.move() != GWSTATUS_CONTINUE_GAME)
+				return "peach didn't survive the script";
+			farthest = max(farthest, world.getPeach()->getX());
+			const vector<GameEvent>& events = world.getEvents();
+			for (size_t e = 0; e < events.size(); e++)
+			{
+				if (events[e].type == GameEvent::spawn  &&  events[e].value == IID_MUSHROOM)
+					mushrooms++;
+				else if (events[e].type == GameEvent::sound  &&
+						 (events[e].value == SOUND_PLAYER_BONK  ||  events[e].value == SOUND_POWERUP_APPEARS))
+					hits++;  // one or the other for every time peach hits the block
+			}
+		}
+	}
+	world.cleanUp();
+
+	  // make sure the script really did what it's meant to before believing the result
+	if (farthest < evictedAt)
+		return "peach never got far enough away for the block's chunk to be evicted";
+	if (hits != 2)
+		return "peach didn't hit the block twice";
+	if (mushrooms != 1)
+		return "bonking the block again after its chunk came back dropped another mushroom";
+	return "";
+}
+
+int main(int argc, char* argv[])
+{
+	string assets = "Assets";
+	string dir = "Playthroughs";
+	double tolerance = 20;
+	int repeat = 5;
+	bool update = false;
+	vector<string> names;
+
+	for (int i = 1; i < argc; i++)
+	{
+		string arg = argv[i];
+		if (arg == "--assets"  &&  i + 1 < argc)
+			assets = argv[++i];
+		else if (arg == "--dir"  &&  i + 1 < argc)
+			dir = argv[++i];
+		else if (arg == "--tolerance"  &&  i + 1 < argc)
+			tolerance = atof(argv[++i]);
+		else if (arg == "--repeat"  &&  i + 1 < argc)
+			repeat = atoi(argv[++i]);
+		else if (arg == "--update")
+			update = true;
+		else
+			names.push_back(arg);
+	}
+	if (repeat < 1)
+		repeat = 1;
+	GraphObject::setTracking(true);
+	if (names.empty())
+	{
+		names.push_back("level01.rec");
+		names.push_back("level02.rec");
+		names.push_back("level03.rec");
+	}
+
+	  // baseline.txt has a line "name hash allocsPerTick" per playthrough, and speed.txt a
+	  // line "name ticksPerSec" (ticksPerSec stays -1 for any that it doesn't have)
+	const string baselineFile = dir + "/baseline.txt";
+	const string speedFile = dir + "/speed.txt";
+	map<string, Result> baseline;
+	{
+		ifstream in(baselineFile.c_str());
+		string line;
+		while (getline(in, line))
+		{
+			if (line.empty()  ||  line[0] == '#')
+				continue;
+			istringstream iss(line);
+			string name;
+			Result r;
+			r.ticksPerSec = -1;
+			if (iss >> name >> hex >> r.hash >> dec >> r.allocsPerTick)
+				baseline[name] = r;
+		}
+	}
+	if (!update  &&  baseline.empty())
+	{
+		cerr << "No baseline in " << baselineFile << " (run with --update to make one)" << endl;
+		return 1;
+	}
+	bool haveSpeeds = false;
+	{
+		ifstream in(speedFile.c_str());
+		string line;
+		while (getline(in, line))
+		{
+			if (line.empty()  ||  line[0] == '#')
+				continue;
+			istringstream iss(line);
+			string name;
+			double ticksPerSec;
+			if (iss >> name >> ticksPerSec  &&  baseline.count(name))
+			{
+				baseline[name].ticksPerSec = ticksPerSec;
+				haveSpeeds = true;
+			}
+		}
+	}
+	if (!update  &&  !haveSpeeds)
+		printf("No speeds in %s for this machine, so they won't be checked (run with --update to make one)\n",
+			   speedFile.c_str());
+
+	bool failed = false;
+	string problem = checkEviction(dir);
+	printf("%-14s %s\n", "eviction", problem.empty() ? "ok" : ("FAIL: " + problem).c_str());
+	if (!problem.empty())
+		failed = true;
+
+	for (size_t n = 0; n < names.size(); n++)
+	{
+		Playthrough p;
+		p.name = names[n];
+		if (!loadPlaythrough(dir + "/" + p.name, p))
+		{
+			cerr << "Cannot read playthrough " << dir << "/" << p.name << endl;
+			return 1;
+		}
+
+		Result best;
+		for (int r = 0; r < repeat; r++)
+		{
+			Result result;
+			if (!replay(p, assets, result))
+				return 1;
+			if (r > 0  &&  result.hash != best.hash)
+			{
+				cerr << p.name << ": replaying it twice gave different results" << endl;
+				failed = true;
+			}
+			if (r == 0  ||  result.ticksPerSec > best.ticksPerSec)
+				best = result;
+		}
+		printf("%-14s hash %016llx  %6d ticks  %10.1f ticks/s", p.name.c_str(), best.hash, best.ticks, best.ticksPerSec);
+		if (best.allocsPerTick >= 0)
+			printf("  %8.3f allocs/tick", best.allocsPerTick);
+
+		if (update)
+		{
+			baseline[p.name] = best;
+			printf("\n");
+			continue;
+		}
+
+		map<string, Result>::const_iterator it = baseline.find(p.name);
+		if (it == baseline.end())
+		{
+			printf("  FAIL (not in the baseline)\n");
+			failed = true;
+			continue;
+		}
+		const Result& base = it->second;
+		string problems;
+		if (best.hash != base.hash)
+			problems += " state differs;";
+		if (base.ticksPerSec > 0  &&  best.ticksPerSec < base.ticksPerSec * (1 - tolerance / 100))
+		{
+			ostringstream oss;
+			oss << " slower (" << static_cast<int>(100 - 100 * best.ticksPerSec / base.ticksPerSec) << "% down);";
+			problems += oss.str();
+		}
+		if (best.allocsPerTick >= 0  &&  base.allocsPerTick >= 0  &&
+			best.allocsPerTick > base.allocsPerTick * (1 + tolerance / 100) + 0.01)
+			problems += " allocates more;";
+		if (AllocStats::enabled())
+		{
+			unsigned long long steady = steadyStateAllocs(p, assets);
+			if (steady > 0)
+			{
+				ostringstream oss;
+				oss << " allocated " << steady << " times after warming up;";
+				problems += oss.str();
+			}
+		}
+		if (problems.empty())
+			printf("  ok\n");
+		else
+		{
+			printf("  FAIL:%s\n", problems.c_str());
+			failed = true;
+		}
+	}
+
+	if (update)
+	{
+		ofstream out(baselineFile.c_str());
+		ofstream speeds(speedFile.c_str());
+		out << "# playthrough  state hash  allocs/tick (-1 if not counted)" << endl;
+		speeds << "# playthrough  ticks/s on this machine (not checked in)" << endl;
+		for (map<string, Result>::const_iterator it = baseline.begin(); it != baseline.end(); it++)
+		{
+			char line[200];
+			snprintf(line, sizeof(line), "%s %016llx %.3f", it->first.c_str(), it->second.hash, it->second.allocsPerTick);
+			out << line << endl;
+			snprintf(line, sizeof(line), "%s %.1f", it->first.c_str(), it->second.ticksPerSec);
+			speeds << line << endl;
+		}
+		if (!out  ||  !speeds)
+		{
+			cerr << "Cannot write " << baselineFile << " and " << speedFile << endl;
+			return 1;
+		}
+		printf("Wrote %s and %s\n", baselineFile.c_str(), speedFile.c_str());
+		return failed ? 1 : 0;
+	}
+	printf(failed ? "FAILED\n" : "PASSED\n");
+	return failed ? 1 : 0;
+}
@@ -2,21 +2,49 @@
 #define SOUNDFX_H_
 
 #include <string>
+#include <cstddef>
+
+  // Every backend hands out a small integer handle for each clip when it is loaded, and
+  // playClip takes that handle, so playing a sound never has to look up or build a name.
 
 #if defined(_WIN32)
 
 #include "irrKlang/irrKlang.h"
 #pragma comment(lib, "irrKlang.lib")
 #include <iostream>
+#include <vector>
 
 class SoundFXController
 {
   public:
 
-	void playClip(std::string soundFile)
+	void playClip(int clip, unsigned int /* tick */)
+	{
+		if (m_engine != nullptr  &&  clip >= 0  &&  clip < static_cast<int>(m_sources.size()))
+			m_engine->play2D(m_sources[clip], false);
+	}
+
+	  // Loads a clip from disk ahead of time and returns its handle, or -1 if it can't be loaded.
+	int preloadClip(std::string soundFile)
+	{
+		if (m_engine == nullptr)
+			return -1;
+		return addSource(m_engine->getSoundSource(soundFile.c_str(), true));
+	}
+
+	  // Registers a clip whose file contents are already in memory and returns its handle, or -1.
+	  // The memory is not copied and has to outlive the sound engine.
+	int loadClip(std::string name, const char* data, std::size_t size)
+	{
+		if (m_engine == nullptr)
+			return -1;
+		return addSource(m_engine->addSoundSourceFromMemory(const_cast<char*>(data), static_cast<irrklang::ik_s32>(size),
+															name.c_str(), false));
+	}
+
+	  // irrKlang doesn't limit voices, so there's nothing to prioritize
+	void setClipPriority(int, int)
 	{
-		if (m_engine != nullptr)
-			m_engine->play2D(soundFile.c_str(), false);
 	}
 
 	void abortClip()
@@ -29,6 +57,15 @@ class SoundFXController
 
   private:
 	irrklang::ISoundEngine* m_engine;
+	std::vector<irrklang::ISoundSource*> m_sources;  // indexed by clip handle
+
+	int addSource(irrklang::ISoundSource* source)
+	{
+		if (source == nullptr)
+			return -1;
+		m_sources.push_back(source);
+		return static_cast<int>(m_sources.size()) - 1;
+	}
 
 	SoundFXController()
 	{
@@ -50,7 +87,7 @@ class SoundFXController
 
 #elif defined(__APPLE__)
 
-#include <memory>
+#include <vector>
 #include <spawn.h>
 #include <csignal>
 #include <cstring>
@@ -62,15 +99,32 @@ class SoundFXController
      : pidValid(false)
     {}
 
-    void playClip(std::string soundFile)
+    void playClip(int clip, unsigned int /* tick */)
     {
+        if (clip < 0  ||  clip >= static_cast<int>(m_files.size()))
+            return;
         char cmd[] = "/usr/bin/afplay";
-        std::unique_ptr<char[]> fileName(new char[soundFile.size()+1]);
-        std::strcpy(fileName.get(), soundFile.c_str());
-        char* argv[] = { cmd, fileName.get(), nullptr };
+        char* argv[] = { cmd, &m_files[clip][0], nullptr };
         abortClip();  // stop anything currently playing
         pidValid = (posix_spawn(&pid, argv[0], nullptr, nullptr, argv, nullptr) == 0);
     }
+
+      // afplay can only play files, so clips have to be played by path
+    int preloadClip(std::string soundFile)
+    {
+        m_files.push_back(soundFile);
+        return static_cast<int>(m_files.size()) - 1;
+    }
+
+    int loadClip(std::string, const char*, std::size_t)
+    {
+        return -1;
+    }
+
+      // only one clip ever plays at a time here anyway
+    void setClipPriority(int, int)
+    {
+    }
     
     void abortClip()
     {
@@ -84,6 +138,66 @@ class SoundFXController
   private:
     pid_t pid;
     bool pidValid;
+    std::vector<std::string> m_files;  // indexed by clip handle
+};
+
+#elif defined(__linux__)
+
+#include "AudioMixer.h"
+#include <vector>
+#include <fstream>
+#include <iterator>
+
+  // Every clip is decoded into memory once and mixed in-process by AudioMixer, so playing a
+  // sound is just queueing a command for the mixer thread.
+
+class SoundFXController
+{
+  public:
+    void playClip(int clip, unsigned int tick)
+    {
+        m_mixer.play(clip, tick);
+    }
+
+    int preloadClip(std::string soundFile)
+    {
+        std::ifstream in(soundFile, std::ios::in | std::ios::binary);
+        if (!in)
+            return -1;
+        std::vector<char> contents((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        return loadClip(soundFile, contents.data(), contents.size());
+    }
+
+    int loadClip(std::string, const char* data, std::size_t size)
+    {
+        std::vector<short> samples;
+        if (!AudioMixer::decodeWav(data, size, samples))
+            return -1;
+        return m_mixer.addClip(samples);
+    }
+
+      // decides which clips keep playing when the mixer runs out of voices
+    void setClipPriority(int clip, int priority)
+    {
+        m_mixer.setClipPriority(clip, priority);
+    }
+
+    void abortClip()
+    {
+        m_mixer.stopAll();
+    }
+
+    static SoundFXController& getInstance();
+
+  private:
+    AudioMixer m_mixer;
+
+    SoundFXController()
+     : m_mixer(createAudioSink())
+    {}
+
+    SoundFXController(const SoundFXController&);
+    SoundFXController& operator=(const SoundFXController&);
 };
 
 #else  // forget about sound
@@ -91,7 +205,10 @@ class SoundFXController
 class SoundFXController
 {
   public:
-    void playClip(std::string) {}
+    void playClip(int, unsigned int) {}
+    int preloadClip(std::string) { return 0; }
+    int loadClip(std::string, const char*, std::size_t) { return 0; }
+    void setClipPriority(int, int) {}
     void abortClip() {}
     static SoundFXController& getInstance();
 };
@@ -0,0 +1,139 @@
+#include "SpatialIndex.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SPATIALINDEX_SSE2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SPATIALINDEX_SSE2
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+void SpatialIndex::reset(int width, int height) {
+	// round up so a partially covered cell at the end still exists
+	m_cols = (width + CELL_SIZE - 1) / CELL_SIZE;
+	m_rows = (height + CELL_SIZE - 1) / CELL_SIZE;
+	if (m_cols < 1)
+		m_cols = 1;
+	if (m_rows < 1)
+		m_rows = 1;
+	// empty the cells instead of dropping them, so a restarted level doesn't have to grow them all over again
+	for (size_t c = 0; c < m_cells.size(); c++) {
+		m_cells[c].actors.clear();
+		m_cells[c].xs.clear();
+		m_cells[c].ys.clear();
+	}
+	m_cells.resize(m_cols * m_rows);
+}
+
+void SpatialIndex::insert(Actor* actor) {
+	cellAt(actor->getX(), actor->getY()).add(actor);
+}
+
+void SpatialIndex::remove(Actor* actor) {
+	Cell& cell = cellAt(actor->getX(), actor->getY());
+	int i = cell.find(actor);
+	if (i >= 0)
+		cell.removeAt(i);
+}
+
+void SpatialIndex::move(Actor* actor, int oldX, int oldY) {
+	Cell& from = cellAt(oldX, oldY);
+	Cell& to = cellAt(actor->getX(), actor->getY());
+	int i = from.find(actor);
+	if (&from == &to) { // still in the same cell, just update the packed position
+		if (i >= 0) {
+			from.xs[i] = actor->getX();
+			from.ys[i] = actor->getY();
+		}
+		return;
+	}
+	if (i >= 0)
+		from.removeAt(i);
+	to.add(actor);
+}
+
+void SpatialIndex::Cell::add(Actor* actor) {
+	actors.push_back(actor);
+	xs.push_back(actor->getX());
+	ys.push_back(actor->getY());
+}
+
+int SpatialIndex::Cell::find(Actor* actor) const {
+	for (size_t i = 0; i < actors.size(); i++)
+		if (actors[i] == actor)
+			return static_cast<int>(i);
+	return -1;
+}
+
+void SpatialIndex::Cell::removeAt(int i) {
+	// order inside a cell doesn't matter, so swap it to the back and pop it
+	actors[i] = actors.back();
+	xs[i] = xs.back();
+	ys[i] = ys.back();
+	actors.pop_back();
+	xs.pop_back();
+	ys.pop_back();
+}
+
+unsigned SpatialIndex::overlapMask(const int* xs, const int* ys, int count, int x1, int y1, int x2, int y2) {
+	// a sprite at (x, y) overlaps the box when x1 - SPRITE_WIDTH < x < x2 + 1, and the same for y. written with
+	// strict compares on both sides because that's all SSE2 has
+	int loX = x1 - SPRITE_WIDTH, hiX = x2 + 1;
+	int loY = y1 - SPRITE_HEIGHT, hiY = y2 + 1;
+	unsigned mask = 0;
+	int i = 0;
+#if defined(__AVX2__)
+	const __m256i lx8 = _mm256_set1_epi32(loX), hx8 = _mm256_set1_epi32(hiX);
+	const __m256i ly8 = _mm256_set1_epi32(loY), hy8 = _mm256_set1_epi32(hiY);
+	for (; i + 8 <= count; i += 8) {
+		__m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(xs + i));
+		__m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ys + i));
+		__m256i in = _mm256_and_si256(_mm256_and_si256(_mm256_cmpgt_epi32(x, lx8), _mm256_cmpgt_epi32(hx8, x)),
+			_mm256_and_si256(_mm256_cmpgt_epi32(y, ly8), _mm256_cmpgt_epi32(hy8, y)));
+		mask |= static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(in))) << i;
+	}
+#endif
+#if defined(SPATIALINDEX_SSE2)
+	const __m128i lx4 = _mm_set1_epi32(loX), hx4 = _mm_set1_epi32(hiX);
+	const __m128i ly4 = _mm_set1_epi32(loY), hy4 = _mm_set1_epi32(hiY);
+	for (; i + 4 <= count; i += 4) {
+		__m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(xs + i));
+		__m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ys + i));
+		__m128i in = _mm_and_si128(_mm_and_si128(_mm_cmpgt_epi32(x, lx4), _mm_cmpgt_epi32(hx4, x)),
+			_mm_and_si128(_mm_cmpgt_epi32(y, ly4), _mm_cmpgt_epi32(hy4, y)));
+		mask |= static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(in))) << i;
+	}
+#endif
+	for (; i < count; i++) // whatever didn't fill a whole register
+		if (xs[i] > loX && xs[i] < hiX && ys[i] > loY && ys[i] < hiY)
+			mask |= 1u << i;
+	return mask;
+}
+
+int SpatialIndex::lowestBit(unsigned mask) {
+#if defined(_MSC_VER)
+	unsigned long bit;
+	_BitScanForward(&bit, mask);
+	return static_cast<int>(bit);
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+
+int SpatialIndex::colOf(int x) const {
+	// anything outside of the level gets clamped into the edge cells
+	if (x < 0)
+		return 0;
+	int col = x / CELL_SIZE;
+	return col < m_cols ? col : m_cols - 1;
+}
+
+int SpatialIndex::rowOf(int y) const {
+	if (y < 0)
+		return 0;
+	int row = y / CELL_SIZE;
+	return row < m_rows ? row : m_rows - 1;
+}
@@ -0,0 +1,78 @@
+#ifndef SPATIALINDEX_H_
+#define SPATIALINDEX_H_
+
+#include "Actor.h"
+#include "GameConstants.h"
+#include <vector>
+
+// Uniform grid over the level used for collision queries and for culling what gets drawn.
+// Every actor is stored only in the cell that contains its bottom-left corner, so a query simply
+// widens its box by one sprite to the left and below to catch every sprite that overlaps it.
+// Each cell also keeps its actors' positions packed in plain int arrays, so a query can test a whole
+// cell against its box with SIMD compares (see overlapMask) instead of going through every actor.
+
+class SpatialIndex {
+public:
+	static const int CELL_SIZE = 4 * SPRITE_WIDTH; // width and height of a cell in pixels
+
+	SpatialIndex() : m_cols(0), m_rows(0) {}
+	void reset(int width, int height); // size of the level in pixels, drops every actor but keeps the cells' memory
+	void insert(Actor* actor);
+	void remove(Actor* actor);
+	void move(Actor* actor, int oldX, int oldY); // only touches the cells if the actor changed cells
+
+	// calls visit(actor) for every actor whose sprite overlaps the box [x1, x2] x [y1, y2] (inclusive, in pixels).
+	// stops as soon as visit returns true and returns whether it stopped early
+	template <typename Visitor>
+	bool query(int x1, int y1, int x2, int y2, Visitor visit) const {
+		int c1 = colOf(x1 - SPRITE_WIDTH + 1), c2 = colOf(x2);
+		int r1 = rowOf(y1 - SPRITE_HEIGHT + 1), r2 = rowOf(y2);
+		for (int r = r1; r <= r2; r++) {
+			for (int c = c1; c <= c2; c++) {
+				const Cell& cell = m_cells[r * m_cols + c];
+				int count = static_cast<int>(cell.actors.size());
+				// actors outside of the level get clamped into the edge cells, so we still need the exact test here
+				for (int i = 0; i < count; i += 32) {
+					int n = count - i < 32 ? count - i : 32;
+					for (unsigned mask = overlapMask(&cell.xs[i], &cell.ys[i], n, x1, y1, x2, y2); mask != 0; mask &= mask - 1)
+						if (visit(cell.actors[i + lowestBit(mask)]))
+							return true;
+				}
+			}
+		}
+		return false;
+	}
+
+	// calls visit(actor) for every actor in the index, with the same early out as query()
+	template <typename Visitor>
+	bool forEach(Visitor visit) const {
+		for (size_t c = 0; c < m_cells.size(); c++)
+			for (size_t i = 0; i < m_cells[c].actors.size(); i++)
+				if (visit(m_cells[c].actors[i]))
+					return true;
+		return false;
+	}
+
+	// bit i is set if a sprite at (xs[i], ys[i]) overlaps the box [x1, x2] x [y1, y2], for the first count (at most 32)
+	// entries. uses AVX2 or SSE2 when the compiler has them, plain compares otherwise
+	static unsigned overlapMask(const int* xs, const int* ys, int count, int x1, int y1, int x2, int y2);
+
+private:
+	struct Cell {
+		std::vector<Actor*> actors;
+		std::vector<int> xs, ys; // position of actors[i], kept in step with it
+		void add(Actor* actor);
+		int find(Actor* actor) const;
+		void removeAt(int i);
+	};
+
+	int m_cols, m_rows;
+	std::vector<Cell> m_cells; // indexed by [row * m_cols + col]
+
+	int colOf(int x) const;
+	int rowOf(int y) const;
+	Cell& cellAt(int x, int y) { return m_cells[rowOf(y) * m_cols + colOf(x)]; }
+	static int lowestBit(unsigned mask);
+};
+
+#endif // SPATIALINDEX_H_
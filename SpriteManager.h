@@ -12,12 +12,19 @@
 #endif
 
 #include "GameConstants.h"
+#include "Trace.h"
 #include <cstring>
 #include <iostream>
 #include <fstream>
 #include <string>
 #include <map>
 #include <memory>
+#include <vector>
+#include <iterator>
+#include <cstddef>
+#include <algorithm>
+#include <atomic>
+#include <thread>
 
 class SpriteManager
 {
@@ -33,106 +40,65 @@ public:
 		m_mipMapped = status;
 	}
 
-	bool loadSprite(std::string filename_tga, int imageID, int frameNum)
+	  // Where to get one sprite frame from: the TGA contents in memory (e.g., mapped from an
+	  // asset pack) if data is non-null, otherwise the named file.
+	struct SpriteSource
 	{
-		  // Load Texture Data From TGA File
-
-		unsigned int spriteID = getSpriteID(imageID, frameNum);
-		if (INVALID_SPRITE_ID == spriteID)
-			return false;
-
-		m_frameCountPerSprite[imageID]++;	// keep track of how many frames per sprite we loaded
-
-		std::string line;
-		std::string contents = "";
-		std::ifstream tgaFile(filename_tga, std::ios::in|std::ios::binary);
-
-		if (!tgaFile) {
-      std::cerr << "Unable to open file in binary mode\n";
-			return false;
-    }
-
-    TGA_HEADER header;
-    tgaFile.read((char *)&header,sizeof(header));
-    unsigned char byteCount = static_cast<unsigned char>(header.pixel_depth) / 8;
-    const long imageSize = header.width_pixels * header.height_pixels * byteCount;
-
-    unsigned int textureWidth = header.width_pixels;
-    unsigned int textureHeight = header.height_pixels;
-
-    std::unique_ptr<char[]> imageData(new char[imageSize]);
-    tgaFile.seekg(18);
-    // Read image data
-		tgaFile.read(imageData.get(), imageSize);
-		if (!tgaFile) {
-      std::cerr << "Unable to read imageSize bytes: " << imageSize; 
-			return false;
-    }
+		int				imageID;
+		int				frameNum;
+		std::string		fileName;
+		const char*		data;
+		std::size_t		size;
+	};
 
-		// image type either 2 (color) or 3 (greyscale)
-    if (header.color_map_type != 0 || (header.image_type != 2 && header.image_type != 3)) {
-      std::cerr << "Bad image type\n";
-			return false;
-    }
-  
-		if (byteCount != 3 && byteCount != 4) {
-      std::cerr << "Bad byte count: " << byteCount;
-			return false;
-    }
-
-    if (header.image_descriptor & 0x20) {
-      // image ios flipped vertically
-      flipVertical(imageData.get(),header.width_pixels,header.height_pixels,byteCount);
-    }
-
-		// Transfer Texture To OpenGL
-
-		glEnable(GL_DEPTH_TEST);
-
-		  // allocate a texture handle
-		GLuint glTextureID;
-		glGenTextures(1, &glTextureID);
-
-		  // bind our new texture
-		glBindTexture(GL_TEXTURE_2D, glTextureID);
-
-		glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+	bool loadSprite(std::string filename_tga, int imageID, int frameNum)
+	{
+		SpriteSource source = { imageID, frameNum, filename_tga, nullptr, 0 };
+		return loadSprites(std::vector<SpriteSource>(1, source)) < 0;
+	}
 
-		if (m_mipMapped)
-		{
-			  // when texture area is small, bilinear filter the closest mipmap
-			glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-			  // when texture area is large, bilinear filter the first mipmap
-			glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		}
-		else
-		{
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		}
+	bool loadSprite(const char* tgaData, std::size_t tgaSize, int imageID, int frameNum)
+	{
+		SpriteSource source = { imageID, frameNum, "", tgaData, tgaSize };
+		return loadSprites(std::vector<SpriteSource>(1, source)) < 0;
+	}
 
-		  // Have the texture wrap both vertically and horizontally.
-		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, static_cast<GLfloat>(GL_REPEAT));
-		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, static_cast<GLfloat>(GL_REPEAT));
+	  // Loads a batch of sprites in two stages: decoding, flipping and building the mipmaps is
+	  // plain CPU work that gets spread over a pool of threads, then the results are handed to
+	  // OpenGL on this thread.  Returns the index of the first source that failed, or -1.
 
-		if (m_mipMapped)
+	int loadSprites(const std::vector<SpriteSource>& sources)
+	{
+		std::vector<DecodedSprite> decoded(sources.size());
+		std::atomic<std::size_t> next(0);
+		auto worker = [&]()
 		{
-			  // build our texture mipmaps
-			  // byteCount of 3 means that BGR data is being supplied. byteCount of 4 means that BGRA data is being supplied.
-            makeMipmaps(byteCount, textureWidth, textureHeight, imageData.get());
-        }
-		else
+			for (std::size_t i = next++; i < sources.size(); i = next++)
+			{
+				Trace::Scope span("decode sprite", sources[i].fileName.c_str());
+				decoded[i].ok = decodeSource(sources[i], m_mipMapped, decoded[i]);
+			}
+		};
+
+		unsigned int numThreads = std::thread::hardware_concurrency();
+		if (numThreads == 0)
+			numThreads = 1;
+		if (numThreads > sources.size())
+			numThreads = static_cast<unsigned int>(sources.size());
+		std::vector<std::thread> pool;
+		for (unsigned int t = 1; t < numThreads; t++)
+			pool.push_back(std::thread([&]() { Trace::nameThread("sprite decoder"); worker(); }));
+		worker();  // this thread pitches in too
+		for (std::size_t t = 0; t < pool.size(); t++)
+			pool[t].join();
+
+		Trace::Scope span("upload sprites");
+		for (std::size_t i = 0; i < sources.size(); i++)
 		{
-			  // byteCount of 3 means that BGR data is being supplied. byteCount of 4 means that BGRA data is being supplied.
-			if (3 == byteCount)
-				glTexImage2D(GL_TEXTURE_2D, 0, 3, textureWidth, textureHeight, 0, GL_BGR, GL_UNSIGNED_BYTE, imageData.get());
-			else if (4 == byteCount)
-				glTexImage2D(GL_TEXTURE_2D, 0, 4, textureWidth, textureHeight, 0, GL_BGRA, GL_UNSIGNED_BYTE, imageData.get());
+			if (!decoded[i].ok  ||  !uploadSprite(decoded[i], sources[i].imageID, sources[i].frameNum))
+				return static_cast<int>(i);
 		}
-
-		m_imageMap[spriteID] = glTextureID;
-
-		return true;
+		return -1;
 	}
 
 	unsigned int getNumFrames(int imageID) const
@@ -280,7 +246,7 @@ private:
 		yout = y * cos(theta) + x * sin(theta);
 	}
   
-  void flipVertical(char *image,unsigned short width,unsigned short height,unsigned int bytes_per_pixel) {
+  static void flipVertical(char *image,unsigned short width,unsigned short height,unsigned int bytes_per_pixel) {
     int bytes_per_row = width * bytes_per_pixel;
     std::unique_ptr<char[]> temp(new char[bytes_per_row]);
     for (int i=0;i<height/2;++i) {
@@ -308,17 +274,223 @@ private:
 		return imageID * MAX_FRAMES_PER_SPRITE + frame;
 	}
 
-    static void makeMipmaps(unsigned char byteCount, unsigned int textureWidth, unsigned int textureHeight, char* imageData)
-    {
-        int format = (byteCount == 3 ? GL_BGR : GL_BGRA);
+	struct MipLevel
+	{
+		unsigned int		width;
+		unsigned int		height;
+		std::vector<char>	pixels;
+	};
+
+	struct DecodedSprite
+	{
+		bool					ok;
+		unsigned char			byteCount;
+		std::vector<MipLevel>	levels;  // levels[0] is the full image
+	};
+
+	  // The CPU half of loading a sprite.  Doesn't touch OpenGL or any member, so it is safe to
+	  // run on any thread.
+
+	static bool decodeSource(const SpriteSource& source, bool mipMapped, DecodedSprite& sprite)
+	{
+		if (source.data != nullptr)
+			return decodeTGA(source.data, source.size, mipMapped, sprite);
+
+		  // Load Texture Data From TGA File
+		std::ifstream tgaFile(source.fileName, std::ios::in|std::ios::binary);
+
+		if (!tgaFile) {
+      std::cerr << "Unable to open file in binary mode\n";
+			return false;
+    }
+
+		std::vector<char> contents((std::istreambuf_iterator<char>(tgaFile)), std::istreambuf_iterator<char>());
+		return decodeTGA(contents.data(), contents.size(), mipMapped, sprite);
+	}
+
+	static bool decodeTGA(const char* tgaData, std::size_t tgaSize, bool mipMapped, DecodedSprite& sprite)
+	{
+    TGA_HEADER header;
+		if (tgaSize < sizeof(header)) {
+      std::cerr << "Unable to read TGA header\n";
+			return false;
+    }
+    std::memcpy(&header, tgaData, sizeof(header));
+    unsigned char byteCount = static_cast<unsigned char>(header.pixel_depth) / 8;
+    const long imageSize = header.width_pixels * header.height_pixels * byteCount;
+
+    // Read image data
+		if (tgaSize < 18 || static_cast<std::size_t>(imageSize) > tgaSize - 18) {
+      std::cerr << "Unable to read imageSize bytes: " << imageSize; 
+			return false;
+    }
+
+		// image type either 2 (color) or 3 (greyscale)
+    if (header.color_map_type != 0 || (header.image_type != 2 && header.image_type != 3)) {
+      std::cerr << "Bad image type\n";
+			return false;
+    }
+  
+		if (byteCount != 3 && byteCount != 4) {
+      std::cerr << "Bad byte count: " << byteCount;
+			return false;
+    }
+
+		sprite.byteCount = byteCount;
+		sprite.levels.assign(1, MipLevel());
+		MipLevel& base = sprite.levels[0];
+		base.width = header.width_pixels;
+		base.height = header.height_pixels;
+		base.pixels.assign(tgaData + 18, tgaData + 18 + imageSize);
+
+    if (header.image_descriptor & 0x20) {
+      // image ios flipped vertically
+      flipVertical(base.pixels.data(),header.width_pixels,header.height_pixels,byteCount);
+    }
+
+#ifndef __APPLE__
+		if (mipMapped)
+			buildMipmaps(sprite);
+#endif
+		return true;
+	}
+
+	  // The OpenGL half of loading a sprite.
+
+	bool uploadSprite(const DecodedSprite& sprite, int imageID, int frameNum)
+	{
+		unsigned int spriteID = getSpriteID(imageID, frameNum);
+		if (INVALID_SPRITE_ID == spriteID)
+			return false;
+
+		m_frameCountPerSprite[imageID]++;	// keep track of how many frames per sprite we loaded
+
+		// Transfer Texture To OpenGL
+
+		glEnable(GL_DEPTH_TEST);
+
+		  // allocate a texture handle
+		GLuint glTextureID;
+		glGenTextures(1, &glTextureID);
+
+		  // bind our new texture
+		glBindTexture(GL_TEXTURE_2D, glTextureID);
+
+		glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+
+		if (m_mipMapped)
+		{
+			  // when texture area is small, bilinear filter the closest mipmap
+			glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+			  // when texture area is large, bilinear filter the first mipmap
+			glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		}
+		else
+		{
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		}
+
+		  // Have the texture wrap both vertically and horizontally.
+		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, static_cast<GLfloat>(GL_REPEAT));
+		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, static_cast<GLfloat>(GL_REPEAT));
+
+		  // rows are tightly packed, which matters for BGR images whose width isn't a multiple of 4
+		glPushClientAttrib(GL_CLIENT_PIXEL_STORE_BIT);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+		  // byteCount of 3 means that BGR data is being supplied. byteCount of 4 means that BGRA data is being supplied.
+		int format = (sprite.byteCount == 3 ? GL_BGR : GL_BGRA);
 #ifdef __APPLE__
-        int internalFormat = (byteCount == 3 ? GL_RGB : GL_RGBA);
-        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, textureWidth, textureHeight, 0, format, GL_UNSIGNED_BYTE, imageData);
-        glGenerateMipmap(GL_TEXTURE_2D);
+		int internalFormat = (sprite.byteCount == 3 ? GL_RGB : GL_RGBA);
+		const MipLevel& base = sprite.levels[0];
+		glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, base.width, base.height, 0, format, GL_UNSIGNED_BYTE, base.pixels.data());
+		if (m_mipMapped)
+			glGenerateMipmap(GL_TEXTURE_2D);
 #else
-        gluBuild2DMipmaps(GL_TEXTURE_2D, byteCount, textureWidth, textureHeight, format, GL_UNSIGNED_BYTE, imageData);
+		  // the mipmaps (if any) were already built by decodeTGA
+		for (std::size_t i = 0; i < sprite.levels.size(); i++)
+		{
+			const MipLevel& level = sprite.levels[i];
+			glTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(i), sprite.byteCount, level.width, level.height, 0, format, GL_UNSIGNED_BYTE, level.pixels.data());
+		}
 #endif
-    }
+		glPopClientAttrib();
+
+		m_imageMap[spriteID] = glTextureID;
+
+		return true;
+	}
+
+	  // Builds the whole mipmap chain on the CPU the way gluBuild2DMipmaps does: scale the image to
+	  // the nearest power of two in each direction, then keep halving it down to 1x1.
+
+	static void buildMipmaps(DecodedSprite& sprite)
+	{
+		MipLevel& base = sprite.levels[0];
+		unsigned int width = nearestPower(base.width);
+		unsigned int height = nearestPower(base.height);
+		if (width != base.width  ||  height != base.height)
+		{
+			MipLevel scaled;
+			scaleImage(base, width, height, sprite.byteCount, scaled);
+			base.width = width;
+			base.height = height;
+			base.pixels.swap(scaled.pixels);
+		}
+		while (sprite.levels.back().width > 1  ||  sprite.levels.back().height > 1)
+		{
+			const MipLevel& from = sprite.levels.back();
+			MipLevel half;
+			scaleImage(from, std::max(from.width / 2, 1u), std::max(from.height / 2, 1u), sprite.byteCount, half);
+			sprite.levels.push_back(half);
+		}
+	}
+
+	  // same rounding as GLU: the closest power of two, rounding 3 * 2^n up
+	static unsigned int nearestPower(unsigned int value)
+	{
+		unsigned int i = 1;
+		if (value == 0)
+			return 1;
+		for (;;)
+		{
+			if (value == 1)
+				return i;
+			else if (value == 3)
+				return i * 4;
+			value >>= 1;
+			i *= 2;
+		}
+	}
+
+	  // box filter: each destination pixel is the average of the source pixels it covers
+	  // (or the nearest one, when scaling up)
+	static void scaleImage(const MipLevel& from, unsigned int width, unsigned int height, unsigned int bytesPerPixel, MipLevel& to)
+	{
+		to.width = width;
+		to.height = height;
+		to.pixels.resize(std::size_t(width) * height * bytesPerPixel);
+		for (unsigned int y = 0; y < height; y++)
+		{
+			unsigned int y1 = y * from.height / height;
+			unsigned int y2 = std::max((y + 1) * from.height / height, y1 + 1);
+			for (unsigned int x = 0; x < width; x++)
+			{
+				unsigned int x1 = x * from.width / width;
+				unsigned int x2 = std::max((x + 1) * from.width / width, x1 + 1);
+				for (unsigned int b = 0; b < bytesPerPixel; b++)
+				{
+					unsigned int sum = 0;
+					for (unsigned int sy = y1; sy < y2; sy++)
+						for (unsigned int sx = x1; sx < x2; sx++)
+							sum += static_cast<unsigned char>(from.pixels[(std::size_t(sy) * from.width + sx) * bytesPerPixel + b]);
+					unsigned int count = (y2 - y1) * (x2 - x1);
+					to.pixels[(std::size_t(y) * width + x) * bytesPerPixel + b] = static_cast<char>((sum + count / 2) / count);
+				}
+			}
+		}
+	}
 };
 
 #endif // SPRITEMANAGER_H_
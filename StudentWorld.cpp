@@ -2,11 +2,17 @@
 #include "GameConstants.h"
 #include "Level.h"
 #include "Actor.h"
+#include "LevelStreamer.h"
+#include "AllocStats.h"
+#include "Trace.h"
 
 #include <string>
 #include <sstream>
-#include <iomanip>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <iostream> // for debugging purposes
+#include <algorithm>
 using namespace std;
 
 GameWorld* createStudentWorld(string assetPath)
@@ -16,33 +22,66 @@ GameWorld* createStudentWorld(string assetPath)
 
 // Students:  Add code to this file, StudentWorld.h, Actor.h, and Actor.cpp
 
+// points randInt on this thread at a world's own generator (if it has one) for as long as it's around
+struct RandomScope {
+    default_random_engine* previous;
+    RandomScope(default_random_engine* engine) : previous(threadRandomEngine()) {
+        if (engine != nullptr)
+            threadRandomEngine() = engine;
+    }
+    ~RandomScope() { threadRandomEngine() = previous; }
+};
+
 StudentWorld::StudentWorld(string assetPath)
     : GameWorld(assetPath)
 {
+    m_worldSlot = Actor::registerWorld(this);
     m_peach = nullptr;
+    m_nextSpawnOrder = 0;
+    m_activationMargin = ACTIVATION_MARGIN;
+    m_ownRandom = false;
+    m_queries = 0;
+    m_levelWidth = VIEW_WIDTH;
+    m_levelHeight = VIEW_HEIGHT;
+    m_sharedLevelNumber = 0;
     finishedLevel = false;
     finishedGame = false;
+    m_statLives = m_statLevel = m_statScore = m_statBoosts = -1;
+    m_statText[0] = '\0';
+    m_nextEvent = 0;
+    m_updating = nullptr;
+    m_events.reserve(64);
+    m_dead.reserve(64);
+    m_parallel = false;
+    m_deferring = false;
+    m_batchActors = 0;
+    m_numBatches = 0;
 }
 
 StudentWorld::~StudentWorld() {
     cleanUp();
+    if (m_worldSlot >= 0)
+        Actor::unregisterWorld(m_worldSlot);
 }
 
 int StudentWorld::init()
 {
-    Level lev(assetPath());
-    ostringstream oss;
-    int level = this->getLevel();
-    // once we get our current level, format our text accordingly
-    if (level > 9) {
-        oss << "level";
+    AllocStats::Scope phase(AllocStats::level);
+    if (m_worldSlot < 0) // there were too many worlds around when we got made, so our actors would have nowhere to find us
+        return GWSTATUS_LEVEL_ERROR;
+    RandomScope random(m_ownRandom ? &m_random : nullptr);
+    string levelFile = levelFileName(getLevel());
+    Trace::Scope span("load level", levelFile.c_str());
+    Level::LoadResult result = Level::load_success;
+    if (m_sharedLevel && m_sharedLevelNumber == getLevel()) { // already read and checked, nothing to open
+        m_level = m_sharedLevel;
     }
     else {
-        oss << "level0";
+        // open our level. this only checks the file, the actual grid gets streamed in a chunk at a time around peach
+        shared_ptr<Level> opened(new Level(assetPath()));
+        result = opened->openLevel(levelFile);
+        m_level = opened;
     }
-    oss << level << ".txt";
-    // load our level
-    Level::LoadResult result = lev.loadLevel(oss.str());
     if (result == Level::load_fail_file_not_found) { // no such existing level
         return GWSTATUS_LEVEL_ERROR;
     }
@@ -51,72 +90,64 @@ int StudentWorld::init()
     }
     else if (result == Level::load_success)
     {
-        Level::GridEntry ge;
-        for (int x = 0; x < GRID_HEIGHT; x++) {
-            for (int y = 0; y < GRID_WIDTH; y++) {
-                ge = lev.getContentsOf(x, y);
-                // calculate our x and y positions
-                int lx = x * SPRITE_WIDTH;
-                int ly = y * SPRITE_HEIGHT;
-                switch (ge) {
-                case Level::peach:
-                    m_peach = new Peach(this, IID_PEACH, lx, ly);
-                    break;
-                case Level::block:
-                    m_actors.push_back(new Block(this, IID_BLOCK, lx, ly));
-                    break;
-                case Level::pipe:
-                    m_actors.push_back(new Pipe(this, IID_PIPE, lx, ly));
-                    break;
-                case Level::goomba:
-                    m_actors.push_back(new Goomba(this, IID_GOOMBA, lx, ly, randInt(0, 1) * 180));
-                    break;
-                case Level::koopa:
-                    m_actors.push_back(new Koopa(this, IID_KOOPA, lx, ly, randInt(0, 1) * 180));
-                    break;
-                case Level::piranha:
-                    m_actors.push_back(new Piranha(this, IID_PIRANHA, lx, ly, randInt(0, 1) * 180));
-                    break;
-                case Level::mushroom_goodie_block:
-                    m_actors.push_back(new Block(this, IID_BLOCK, lx, ly, 0, 2, 1.0, 1));
-                    break;
-                case Level::flower_goodie_block:
-                    m_actors.push_back(new Block(this, IID_BLOCK, lx, ly, 0, 2, 1.0, 2));
-                    break;
-                case Level::star_goodie_block:
-                    m_actors.push_back(new Block(this, IID_BLOCK, lx, ly, 0, 2, 1.0, 3));
-                    break;
-                case Level::flag:
-                    m_actors.push_back(new Flag(this, IID_FLAG, lx, ly));
-                    break;
-                case Level::mario:
-                    m_actors.push_back(new Mario(this, IID_MARIO, lx, ly));
-                    break;
-                };
-
-            }
-        }
+        // the level can be bigger than the screen, so size everything off of what we actually loaded
+        m_levelWidth = m_level->getWidth() * SPRITE_WIDTH;
+        m_levelHeight = m_level->getHeight() * SPRITE_HEIGHT;
+        m_index.reset(m_levelWidth, m_levelHeight);
+        if (m_level != m_sharedLevel)
+            m_streamer.reset(new LevelStreamer(*m_level));
+        m_loadedChunks.clear();
+        m_chunks.assign(LevelStreamer::numChunks(*m_level), ChunkRecord());
+        m_chunksBySpawn.clear();
+        m_statLives = -1; // make sure the status text gets rebuilt on the first tick
+
+        m_peach = new Peach(this, IID_PEACH, m_level->getPeachX() * SPRITE_WIDTH, m_level->getPeachY() * SPRITE_HEIGHT);
+        m_peach->setSpawnOrder(m_nextSpawnOrder++);
+        m_index.insert(m_peach);
+        if (!streamChunks()) // make sure everything around peach is there before the first tick
+            return GWSTATUS_LEVEL_ERROR;
+        updateCamera();
     }
     return GWSTATUS_CONTINUE_GAME;
 }
 
 int StudentWorld::move()
 {
+    RandomScope random(m_ownRandom ? &m_random : nullptr);
+    m_events.clear();
+    m_nextEvent = 0;
+
+    // load whatever chunks peach is getting close to and drop the ones far behind her
+    AllocStats::Scope phase(AllocStats::stream);
+    Trace::Scope span("stream");
+    streamChunks();
+
+    phase.set(AllocStats::peach);
+    span.set("peach");
     if (m_peach->isAlive()) // make peach do something first
-        m_peach->doSomething();
-    vector<Actor*>::iterator actor = m_actors.begin();
-    while (actor != m_actors.end()) { // go through each actor
-        if (!m_peach->isAlive()) { // check if one of our actors caused peach to die. if so, play dying sound and decrease lives
-            playSound(SOUND_PLAYER_DIE);
-            decLives();
-            return GWSTATUS_PLAYER_DIED;
-        }
-        if ((*actor)->isAlive()) { // make our actor do something
-            (*actor)->doSomething();
+        update(m_peach);
+    // only actors inside the activation region around peach get to do something. everything else is asleep
+    phase.set(AllocStats::actors);
+    span.set("actors");
+    wakeActors();
+    if (m_parallel) {
+        if (!updateInParallel())
+            return peachDied();
+    }
+    else {
+        // anything spawned while we go through the list gets appended to it, so use an index rather than an iterator
+        for (size_t i = 0; i < m_awake.size(); i++) { // go through each awake actor
+            if (!m_peach->isAlive()) { // check if one of our actors caused peach to die
+                return peachDied();
+            }
+            if (m_awake[i]->isAlive()) { // make our actor do something
+                update(m_awake[i]);
+            }
         }
-        actor++;
     }
-
+    phase.set(AllocStats::events);
+    span.set("events");
+    applyTickEvents(); // now that everyone has moved, hand out points, play sounds and see if the level is over
 
     if (finishedLevel) { // finished current level
         finishedLevel = false;
@@ -130,129 +161,723 @@ int StudentWorld::move()
         return GWSTATUS_PLAYER_WON;
     }
 
-    actor = m_actors.begin(); // go through each actor to see if they died
-    while (actor != m_actors.end()) {
-        if (!(*actor)->isAlive()) { // if they did die, delete them and clean them from the vector
-            delete (*actor);
-            actor = m_actors.erase(actor);
-        }
-        else {
-            actor++;
-        }
+    vector<Actor*>::iterator actor = m_dead.begin(); // delete everything that died this tick and clean them from the index
+    while (actor != m_dead.end()) {
+        m_index.remove(*actor);
+        delete (*actor);
+        actor++;
     }
+    m_dead.clear();
 
+    phase.set(AllocStats::status);
+    span.set("status");
+    updateCamera(); // keep peach on screen
+
+    updateStatusText();
+
+    return GWSTATUS_CONTINUE_GAME;
+}
+
+int StudentWorld::peachDied()
+{
+    // play dying sound and decrease lives (after anything that happened this tick)
+    AllocStats::Scope phase(AllocStats::events);
+    Trace::Scope span("peach died");
+    applyTickEvents();
+    playSound(SOUND_PLAYER_DIE);
+    decLives();
+    return GWSTATUS_PLAYER_DIED;
+}
+
+void StudentWorld::updateStatusText()
+{
+    int boosts = (getPeach()->hasStarBoost() ? 1 : 0) | (getPeach()->hasShootBoost() ? 2 : 0) | (getPeach()->hasJumpBoost() ? 4 : 0);
+    // this changes a handful of times per level, so don't rebuild it every tick
+    if (getLives() == m_statLives && getLevel() == m_statLevel && getScore() == m_statScore && boosts == m_statBoosts)
+        return;
+    m_statLives = getLives();
+    m_statLevel = getLevel();
+    m_statScore = getScore();
+    m_statBoosts = boosts;
 
-    ostringstream oss;
     // set up our display text to display lives, levels, and points
-    oss << "Lives: " << getLives();
-    oss.fill('0');
-    oss << "  Level: " << setw(2) << getLevel();
-    oss.fill('0');
-    oss << "  Points: " << setw(6) << getScore();
+    int len = snprintf(m_statText, sizeof(m_statText), "Lives: %d  Level: %02d  Points: %06d", m_statLives, m_statLevel, m_statScore);
 
     // append any powerup text
-    if (getPeach()->hasStarBoost())
-        oss << " StarPower!";
-    if (getPeach()->hasShootBoost())
-        oss << " ShootPower!";
-    if (getPeach()->hasJumpBoost())
-        oss << " JumpPower!";
+    if (boosts & 1)
+        len += snprintf(m_statText + len, sizeof(m_statText) - len, " StarPower!");
+    if (boosts & 2)
+        len += snprintf(m_statText + len, sizeof(m_statText) - len, " ShootPower!");
+    if (boosts & 4)
+        len += snprintf(m_statText + len, sizeof(m_statText) - len, " JumpPower!");
 
     // display our text
-    setGameStatText(oss.str());
-
-    return GWSTATUS_CONTINUE_GAME;
+    setGameStatText(m_statText);
 }
 
 void StudentWorld::cleanUp()
 {
-    // delete our peach first
+    AllocStats::Scope phase(AllocStats::level);
+    Trace::Scope span("unload level");
+    // delete our peach first (taking her out of the index so she doesn't get deleted twice)
+    if (m_peach != nullptr)
+        m_index.remove(m_peach);
     delete m_peach;
     m_peach = nullptr;
 
-    vector<Actor*>::iterator actor = m_actors.begin();
-    // delete every actor in our vector next
-    while (actor != m_actors.end()) {
-        delete (*actor);
-        actor = m_actors.erase(actor);
-    }
+    // delete every actor in our index next
+    m_index.forEach([](Actor* actor) {
+        delete actor;
+        return false;
+    });
+    m_index.reset(m_levelWidth, m_levelHeight);
+    m_chunksBySpawn.clear(); // m_chunks gets redone by init(), which can reuse what its records have grown
+    m_awake.clear();
+    m_dead.clear();
+    m_nextSpawnOrder = 0;
+
+    // stop streaming before we let go of the level it reads from
+    m_streamer.reset();
+    m_level.reset();
+    m_loadedChunks.clear();
 }
 
-Actor* StudentWorld::isBlockingObject(int x, int y, bool includePeach, bool moving) {
-    // if we are not peach (enemy), the first thing we want to look for is peach to attack her
-    if (includePeach && !moving) { // we only want to attack if we overlap
-        int curX = m_peach->getX();
-        int curY = m_peach->getY();
+string StudentWorld::levelFileName(int levelNumber) {
+    // once we get our current level, format our text accordingly
+    ostringstream oss;
+    if (levelNumber > 9) {
+        oss << "level";
+    }
+    else {
+        oss << "level0";
+    }
+    oss << levelNumber << ".txt";
+    return oss.str();
+}
 
-        // all of the code essentially checks if our peach sprite contains the coordinate
-        bool containsLeft = (x >= curX && x <= curX + SPRITE_WIDTH - 1); // see if peach contains the left side of our sprite
-        bool containsBottom = (y >= curY && y <= curY + SPRITE_HEIGHT - 1); // see if peach contains the bottom side of our sprite
-        bool containsRight = (x + SPRITE_WIDTH - 1 >= curX && x + SPRITE_WIDTH - 1 <= curX + SPRITE_WIDTH - 1); // see if peach contains the right side of our sprite
-        bool containsTop = (y + SPRITE_HEIGHT - 1 >= curY && y + SPRITE_HEIGHT - 1 <= curY + SPRITE_HEIGHT - 1); // see if peach contains the top side of our sprite
+Actor* StudentWorld::findOverlap(int x, int y, int kinds) {
+    // the index doesn't keep actors in any particular order, so out of everything that overlaps we take whichever
+    // was spawned first (lowest spawn order), which is the order the actors get to do something in
+    Actor* found = nullptr;
+    forEachOverlap(x, y, kinds, [&](Actor* actor) {
+        if (found == nullptr || actor->getSpawnOrder() < found->getSpawnOrder())
+            found = actor;
+        return false;
+    });
+    return found;
+}
 
-        if ((containsRight || containsLeft) && (containsBottom || containsTop)) { // it only needs to contain either the right or left and either the top or bottom
-            return m_peach;
+Actor* StudentWorld::sweep(int& x, int& y, int dx, int dy, int kinds) {
+    int distance = abs(dx + dy); // only one of them is nonzero
+    if (distance == 0)
+        return findOverlap(x, y, kinds);
+    countQuery();
+
+    // one query over the box that the sprite covers along the whole way. for everything in it, work out how far we
+    // get before touching it and keep the closest (ties go to whoever does something first, like findOverlap)
+    int x1 = dx < 0 ? x + dx : x;
+    int y1 = dy < 0 ? y + dy : y;
+    Actor* hit = nullptr;
+    int stop = distance;
+    m_index.query(x1, y1, x1 + abs(dx) + SPRITE_WIDTH - 1, y1 + abs(dy) + SPRITE_HEIGHT - 1, [&](Actor* actor) {
+        if ((actor->getKind() & kinds) == 0 || !actor->isAlive())
+            return false;
+        int ax = actor->getX();
+        int ay = actor->getY();
+        int gap;
+        if (dx > 0)
+            gap = ax - x - SPRITE_WIDTH;
+        else if (dx < 0)
+            gap = x - ax - SPRITE_WIDTH;
+        else if (dy > 0)
+            gap = ay - y - SPRITE_HEIGHT;
+        else
+            gap = y - ay - SPRITE_HEIGHT;
+        if (gap < 0) // we already overlap it
+            gap = 0;
+        if (gap < stop || (gap == stop && hit != nullptr && actor->getSpawnOrder() < hit->getSpawnOrder())) {
+            hit = actor;
+            stop = gap;
         }
-    }
+        return false;
+    });
 
-    // initialize iterator to go through our other actors
-    vector<Actor*>::iterator actor = m_actors.begin();
-    while (actor != m_actors.end()) {
-        if (moving && !(*actor)->isCollidable()) { // if we are moving, we only want to go through collidable actors
-            actor++;
-            continue;
-        }
-        // this is the exact same code as above for peach
-        int curX = (*actor)->getX();
-        int curY = (*actor)->getY();
-
-        bool containsLeft = (x >= curX && x <= curX + SPRITE_WIDTH - 1);
-        bool containsBottom = (y >= curY && y <= curY + SPRITE_HEIGHT - 1);
-        bool containsRight = (x + SPRITE_WIDTH - 1 >= curX && x + SPRITE_WIDTH - 1 <= curX + SPRITE_WIDTH - 1);
-        bool containsTop = (y + SPRITE_HEIGHT - 1 >= curY && y + SPRITE_HEIGHT - 1 <= curY + SPRITE_HEIGHT - 1);
-
-        if ((containsRight || containsLeft) && (containsBottom || containsTop)) {
-            // again, if our current actor contains either the left or right and either top or bottom of our sprite, then we return it
-            return *actor;
-        }
+    x += dx > 0 ? stop : dx < 0 ? -stop : 0;
+    y += dy > 0 ? stop : dy < 0 ? -stop : 0;
+    return hit;
+}
 
-        actor++;
-    }
+void StudentWorld::postScore(int points) {
+    post(GameEvent::score, nullptr, points);
+}
+
+void StudentWorld::postSound(int soundID) {
+    post(GameEvent::sound, nullptr, soundID);
+}
+
+void StudentWorld::postBonk(Actor* target) {
+    post(GameEvent::damage, target, 0);
+}
 
-    return nullptr;
+void StudentWorld::postPowerup(int powerup) {
+    post(GameEvent::powerup, m_peach, powerup);
 }
 
 void StudentWorld::CreatePowerup(int goodie, int x, int y) {
     switch (goodie) { // int goodie represents what goodie should be created
     case 1: // mushroom
-        m_actors.push_back(new Mushroom(this, IID_MUSHROOM, x, y));
+        post(GameEvent::spawn, nullptr, IID_MUSHROOM, x, y);
         break;
     case 2: // flower
-        m_actors.push_back(new Flower(this, IID_FLOWER, x, y));
+        post(GameEvent::spawn, nullptr, IID_FLOWER, x, y);
         break;
     case 3: // star
-        m_actors.push_back(new Star(this, IID_STAR, x, y));
+        post(GameEvent::spawn, nullptr, IID_STAR, x, y);
         break;
     }
 }
 
 void StudentWorld::CreateFireball(bool peach, int x, int y, int dir) {
-    if (peach) // if peach is shooting, we make a peachfireball. otherwise, make a piranhafireball
-        m_actors.push_back(new PeachFireball(this, IID_PEACH_FIRE, x, y, dir));
-    else
-        m_actors.push_back(new PiranhaFireball(this, IID_PIRANHA_FIRE, x, y, dir));
+    // if peach is shooting, we make a peachfireball. otherwise, make a piranhafireball
+    post(GameEvent::spawn, nullptr, peach ? IID_PEACH_FIRE : IID_PIRANHA_FIRE, x, y, dir);
 }
 
 void StudentWorld::CreateShell(int x, int y, int dir) {
-    m_actors.push_back(new Shell(this, IID_SHELL, x, y, dir));
+    post(GameEvent::spawn, nullptr, IID_SHELL, x, y, dir);
 }
 
 void StudentWorld::NextLevel(bool mario) {
-    if (mario) { // touched mario
-        finishedGame = true;
+    post(GameEvent::levelEnd, nullptr, mario ? 1 : 0);
+}
+
+void StudentWorld::postMove(Actor* actor, int x, int y) {
+    post(GameEvent::move, actor, 0, x, y);
+}
+
+void StudentWorld::postDeath(Actor* actor) {
+    post(GameEvent::die, actor, 0);
+}
+
+// while the actors decide in a parallel update, each thread keeps track of whose turn it is and where that batch's
+// events go, since they can't all share m_updating and m_events
+static thread_local Actor* t_updating = nullptr;
+static thread_local vector<GameEvent>* t_events = nullptr;
+thread_local unsigned long long* StudentWorld::t_queries = nullptr;
+
+void StudentWorld::post(GameEvent::Type type, Actor* target, int value, int x, int y, int dir) {
+    Actor* poster = m_deferring ? t_updating : m_updating;
+    GameEvent event = { type, poster != nullptr ? static_cast<int>(poster->getSpawnOrder()) : -1, target, value, x, y, dir };
+    if (m_deferring)
+        t_events->push_back(event);
+    else
+        m_events.push_back(event);
+}
+
+void StudentWorld::update(Actor* actor) {
+    m_updating = actor;
+    actor->doSomething();
+    m_updating = nullptr;
+    applyEvents(); // whatever it did to everyone else happens before the next actor gets to look at the world
+}
+
+bool StudentWorld::updateInParallel() {
+    // only the actors awake right now get to decide, anything spawned while we apply their decisions waits for next tick
+    size_t count = m_awake.size();
+    if (count == 0)
+        return true;
+    m_batchActors = count;
+    if (!m_pool)
+        m_pool.reset(new WorkerPool);
+    // a few batches per thread so one busy corner of the level doesn't hold everybody up. how the actors get split up
+    // doesn't change anything, since the batches get applied back in order
+    m_numBatches = static_cast<int>(min(count, static_cast<size_t>(m_pool->numThreads() * 4)));
+    if (m_batchEvents.size() < static_cast<size_t>(m_numBatches)) {
+        m_batchEvents.resize(m_numBatches);
+        m_batchQueries.resize(m_numBatches);
+    }
+
+    m_deferring = true;
+    m_pool->run(m_numBatches, updateBatch, this);
+    m_deferring = false;
+    for (int batch = 0; batch < m_numBatches; batch++)
+        m_queries += m_batchQueries[batch];
+
+    // now apply what everybody decided, one actor at a time in the usual order. an actor's events are all next to each
+    // other in its batch, so we just walk through each batch alongside its actors
+    for (int batch = 0; batch < m_numBatches; batch++) {
+        const vector<GameEvent>& events = m_batchEvents[batch];
+        size_t next = 0;
+        for (size_t i = batchStart(batch); i < batchStart(batch + 1); i++) {
+            if (!m_peach->isAlive()) // check if one of our actors caused peach to die
+                return false;
+            Actor* actor = m_awake[i];
+            int source = static_cast<int>(actor->getSpawnOrder());
+            bool stillAlive = actor->isAlive(); // if someone earlier in the order killed it, it doesn't get to do anything
+            for (; next < events.size() && events[next].source == source; next++)
+                if (stillAlive)
+                    m_events.push_back(events[next]);
+            applyEvents();
+        }
+    }
+    return true;
+}
+
+void StudentWorld::updateBatch(void* world, int batch) {
+    StudentWorld* sw = static_cast<StudentWorld*>(world);
+    AllocStats::Scope phase(AllocStats::actors); // we might be on a worker thread, which doesn't know what tick phase it is
+    Trace::Scope span("update batch");
+    vector<GameEvent>& events = sw->m_batchEvents[batch];
+    events.clear();
+    t_events = &events;
+    unsigned long long queries = 0; // on our own stack, so batches on other threads never touch it
+    t_queries = &queries;
+    for (size_t i = sw->batchStart(batch); i < sw->batchStart(batch + 1); i++) {
+        Actor* actor = sw->m_awake[i];
+        if (actor->isAlive()) {
+            t_updating = actor;
+            actor->doSomething();
+        }
+    }
+    t_updating = nullptr;
+    t_events = nullptr;
+    t_queries = nullptr;
+    sw->m_batchQueries[batch] = queries;
+}
+
+size_t StudentWorld::batchStart(int batch) const {
+    // the awake actors (as of when the parallel update started) split as evenly as possible
+    return batch * m_batchActors / m_numBatches;
+}
+
+void StudentWorld::applyEvents() {
+    // spawns, bonks and powerups get applied right after the actor that posted them, so nobody can tell they were
+    // deferred. anything an event causes in turn (a koopa dropping its shell when it gets bonked) gets moved up to
+    // right behind it, so things still happen in the same order as if the actors had done them directly
+    for (size_t i = m_nextEvent; i < m_events.size(); i++) {
+        GameEvent event = m_events[i]; // applying it can add events, so don't hold onto a reference
+        size_t caused = m_events.size();
+        switch (event.type) {
+        case GameEvent::spawn:
+            spawnActor(event.value, event.x, event.y, event.dir);
+            break;
+        case GameEvent::damage:
+            if (!event.target->isAlive()) // someone else got to it first (only happens in a parallel update)
+                break;
+            m_updating = event.target; // whatever the bonk posts came from whoever got bonked
+            event.target->bonk();
+            m_updating = nullptr;
+            break;
+        case GameEvent::powerup:
+            m_peach->powerup(event.value);
+            break;
+        case GameEvent::move:
+            event.target->moveTo(event.x, event.y);
+            break;
+        case GameEvent::die:
+            event.target->setAlive(false);
+            break;
+        default: // points, sounds and level ends wait until everyone has moved
+            break;
+        }
+        rotate(m_events.begin() + i + 1, m_events.begin() + caused, m_events.end());
+    }
+    m_nextEvent = m_events.size();
+}
+
+void StudentWorld::applyTickEvents() {
+    for (size_t i = 0; i < m_events.size(); i++) {
+        const GameEvent& event = m_events[i];
+        switch (event.type) {
+        case GameEvent::score:
+            increaseScore(event.value);
+            break;
+        case GameEvent::sound:
+            playSound(event.value);
+            break;
+        case GameEvent::levelEnd:
+            if (event.value) // touched mario
+                finishedGame = true;
+            else // touched flag
+                finishedLevel = true;
+            break;
+        default: // already applied
+            break;
+        }
+    }
+}
+
+void StudentWorld::spawnActor(int imageID, int x, int y, int dir) {
+    Actor* actor = makeActor(imageID, x, y, dir);
+    if (actor != nullptr)
+        addActor(actor);
+}
+
+Actor* StudentWorld::makeActor(int imageID, int x, int y, int dir) {
+    // everything that can move around on its own, so it can get spawned mid-level or come back with an evicted chunk
+    switch (imageID) {
+    case IID_MUSHROOM:
+        return new Mushroom(this, IID_MUSHROOM, x, y);
+    case IID_FLOWER:
+        return new Flower(this, IID_FLOWER, x, y);
+    case IID_STAR:
+        return new Star(this, IID_STAR, x, y);
+    case IID_PEACH_FIRE:
+        return new PeachFireball(this, IID_PEACH_FIRE, x, y, dir);
+    case IID_PIRANHA_FIRE:
+        return new PiranhaFireball(this, IID_PIRANHA_FIRE, x, y, dir);
+    case IID_SHELL:
+        return new Shell(this, IID_SHELL, x, y, dir);
+    case IID_GOOMBA:
+        return new Goomba(this, IID_GOOMBA, x, y, dir);
+    case IID_KOOPA:
+        return new Koopa(this, IID_KOOPA, x, y, dir);
+    default:
+        return nullptr;
+    }
+}
+
+void StudentWorld::getVisibleObjects(int x1, int y1, int x2, int y2, vector<GraphObject*>& objects) {
+    // only hand back what's near the camera so drawing doesn't depend on how big the level is
+    m_index.query(x1, y1, x2, y2, [&](Actor* actor) {
+        objects.push_back(actor);
+        return false;
+    });
+}
+
+// flat colours for observeRGB, indexed by image ID. roughly what each sprite looks like from far away
+static const unsigned char observeColors[][3] = {
+    { 255, 150, 200 }, // peach
+    { 60, 170, 60 },   // koopa
+    { 150, 80, 30 },   // goomba
+    { 40, 220, 140 },  // shell
+    { 30, 120, 30 },   // piranha
+    { 230, 30, 30 },   // mario
+    { 190, 110, 50 },  // block
+    { 40, 200, 40 },   // pipe
+    { 255, 230, 0 },   // star
+    { 255, 130, 0 },   // flower
+    { 200, 60, 60 },   // mushroom
+    { 240, 240, 240 }, // flag
+    { 255, 80, 0 },    // piranha fire
+    { 255, 200, 80 },  // peach fire
+};
+static const int NUM_OBSERVE_COLORS = sizeof(observeColors) / sizeof(observeColors[0]);
+
+// the first of pixels pixels (spread over viewSize view pixels) whose center is at or past viewPos
+static int firstPixel(int viewPos, int pixels, int viewSize) {
+    int num = 2 * viewPos * pixels - viewSize;
+    if (num <= 0)
+        return 0;
+    return min(pixels, (num + 2 * viewSize - 1) / (2 * viewSize));
+}
+
+// how many pixels observeRGB works out at a time, so its depth buffer fits on the stack
+static const int OBSERVE_BLOCK_PIXELS = 128 * 128;
+
+void StudentWorld::observeGrid(unsigned char* cells) const {
+    AllocStats::Scope phase(AllocStats::observe);
+    memset(cells, 0, GRID_WIDTH * GRID_HEIGHT);
+    if (m_peach == nullptr)
+        return;
+    int camX = getCameraX();
+    int camY = getCameraY();
+    auto cellOf = [&](Actor* actor) {
+        int cx = actor->getX() + SPRITE_WIDTH / 2 - camX;
+        int cy = actor->getY() + SPRITE_HEIGHT / 2 - camY;
+        if (cx < 0 || cx >= VIEW_WIDTH || cy < 0 || cy >= VIEW_HEIGHT)
+            return -1;
+        return (GRID_HEIGHT - 1 - cy / SPRITE_HEIGHT) * GRID_WIDTH + cx / SPRITE_WIDTH;
+    };
+    // one query for the whole screen. each cell remembers how deep its object is and only takes one at the same depth
+    // or in front, which comes out the same as drawing back to front. peach still goes last
+    unsigned char depths[GRID_WIDTH * GRID_HEIGHT];
+    memset(depths, GraphObject::NUM_DEPTHS, sizeof(depths));
+    m_index.query(camX, camY, camX + VIEW_WIDTH - 1, camY + VIEW_HEIGHT - 1, [&](Actor* actor) {
+        if (actor == m_peach || !actor->isAlive() || !actor->isVisible())
+            return false;
+        int cell = cellOf(actor);
+        if (cell >= 0 && actor->getDepth() <= depths[cell]) {
+            depths[cell] = static_cast<unsigned char>(actor->getDepth());
+            cells[cell] = static_cast<unsigned char>(actor->getID() + 1);
+        }
+        return false;
+    });
+    int cell = cellOf(m_peach);
+    if (m_peach->isVisible() && cell >= 0)
+        cells[cell] = static_cast<unsigned char>(m_peach->getID() + 1);
+}
+
+void StudentWorld::observeRGB(unsigned char* pixels, int width, int height) const {
+    AllocStats::Scope phase(AllocStats::observe);
+    // nothing there is black, same as the window
+    memset(pixels, 0, static_cast<size_t>(width) * height * 3);
+    if (m_peach == nullptr || width <= 0 || height <= 0)
+        return;
+    int camX = getCameraX();
+    int camY = getCameraY();
+    // paints actor's pixels inside [bx1, bx2) x [by1, by2). with depths (one per pixel of that block) it only paints
+    // over what's at the same depth or further back, without it paints over everything
+    auto paint = [&](Actor* actor, int bx1, int by1, int bx2, int by2, unsigned char* depths) {
+        int id = actor->getID();
+        if (id < 0 || id >= NUM_OBSERVE_COLORS)
+            return;
+        unsigned char depth = static_cast<unsigned char>(actor->getDepth());
+        int vx = actor->getX() - camX;
+        int vy = actor->getY() - camY;
+        int x1 = max(bx1, firstPixel(vx, width, VIEW_WIDTH)), x2 = min(bx2, firstPixel(vx + SPRITE_WIDTH, width, VIEW_WIDTH));
+        int y1 = max(by1, firstPixel(vy, height, VIEW_HEIGHT)), y2 = min(by2, firstPixel(vy + SPRITE_HEIGHT, height, VIEW_HEIGHT));
+        for (int y = y1; y < y2; y++) {
+            unsigned char* p = pixels + (static_cast<size_t>(height - 1 - y) * width + x1) * 3;
+            unsigned char* d = depths != nullptr ? depths + (y - by1) * (bx2 - bx1) + (x1 - bx1) : nullptr;
+            for (int x = x1; x < x2; x++, p += 3) {
+                if (d != nullptr) {
+                    if (depth > d[x - x1])
+                        continue;
+                    d[x - x1] = depth;
+                }
+                p[0] = observeColors[id][0];
+                p[1] = observeColors[id][1];
+                p[2] = observeColors[id][2];
+            }
+        }
+    };
+    // same as observeGrid, one query per block of pixels with a depth for each pixel (usually the whole picture is one
+    // block). anything partly in the block can cover some pixel centers, so ask for a sprite beyond every edge
+    unsigned char depths[OBSERVE_BLOCK_PIXELS];
+    int blockWidth = min(width, OBSERVE_BLOCK_PIXELS);
+    int blockHeight = max(1, OBSERVE_BLOCK_PIXELS / blockWidth);
+    for (int by1 = 0; by1 < height; by1 += blockHeight) {
+        for (int bx1 = 0; bx1 < width; bx1 += blockWidth) {
+            int bx2 = min(width, bx1 + blockWidth), by2 = min(height, by1 + blockHeight);
+            memset(depths, GraphObject::NUM_DEPTHS, static_cast<size_t>(bx2 - bx1) * (by2 - by1));
+            m_index.query(camX + bx1 * VIEW_WIDTH / width - SPRITE_WIDTH, camY + by1 * VIEW_HEIGHT / height - SPRITE_HEIGHT,
+                          camX + bx2 * VIEW_WIDTH / width + SPRITE_WIDTH - 1,
+                          camY + by2 * VIEW_HEIGHT / height + SPRITE_HEIGHT - 1, [&](Actor* actor) {
+                if (actor != m_peach && actor->isAlive() && actor->isVisible())
+                    paint(actor, bx1, by1, bx2, by2, depths);
+                return false;
+            });
+        }
+    }
+    if (m_peach->isVisible())
+        paint(m_peach, 0, 0, width, height, nullptr);
+}
+
+void StudentWorld::actorDied(Actor* actor) {
+    if (actor != m_peach) // peach sticks around until cleanUp(), everyone else gets deleted at the end of the tick
+        m_dead.push_back(actor);
+}
+
+void StudentWorld::addActor(Actor* actor) {
+    actor->setSpawnOrder(m_nextSpawnOrder++);
+    m_index.insert(actor);
+    m_awake.push_back(actor); // anything spawned mid-tick is right next to whoever spawned it, so it gets to move this tick too
+}
+
+bool StudentWorld::streamChunks() {
+    const int chunkPixels = LevelStreamer::CHUNK_WIDTH * SPRITE_WIDTH;
+    // we need every chunk that the activation region (or the screen, if that's wider) touches, plus the sprite beyond
+    // it that actors at the edge probe into
+    int reach = max(m_activationMargin, VIEW_WIDTH / 2) + SPRITE_WIDTH;
+    int px = m_peach->getX();
+    int first = max(0, (px - reach) / chunkPixels);
+    int numChunks = static_cast<int>(m_chunks.size());
+    int last = min(numChunks - 1, (px + SPRITE_WIDTH - 1 + reach) / chunkPixels);
+
+    // anything we need right now gets read immediately if the loader thread hasn't gotten to it yet
+    for (int chunk = first; chunk <= last; chunk++) {
+        if (find(m_loadedChunks.begin(), m_loadedChunks.end(), chunk) != m_loadedChunks.end())
+            continue;
+        if (!readChunk(chunk))
+            return false;
+        spawnChunk(chunk);
+    }
+
+    // the chunk on either side gets read ahead of time in the background (unless it's a shared level, which has nothing
+    // left to read). it only gets spawned once it's actually needed though (by the loop above), so what's in the world
+    // never depends on how fast the loader thread happens to be
+    for (int chunk = first - 1; m_streamer && chunk <= last + 1; chunk += last - first + 2) {
+        if (chunk < 0 || chunk >= numChunks ||
+            find(m_loadedChunks.begin(), m_loadedChunks.end(), chunk) != m_loadedChunks.end())
+            continue;
+        m_streamer->request(chunk);
+    }
+
+    // and anything two chunks past that gets thrown away
+    vector<int>::iterator chunk = m_loadedChunks.begin();
+    while (chunk != m_loadedChunks.end()) {
+        if (*chunk < first - 2 || *chunk > last + 2) {
+            evictChunk(*chunk);
+            chunk = m_loadedChunks.erase(chunk);
+        }
+        else {
+            chunk++;
+        }
+    }
+    return true;
+}
+
+bool StudentWorld::readChunk(int chunk) {
+    if (!m_streamer) // a shared level is all in memory already
+        return m_level->loadColumns(chunk * LevelStreamer::CHUNK_WIDTH, LevelStreamer::chunkColumns(*m_level, chunk), m_chunkGrid);
+    return m_streamer->take(chunk, m_chunkGrid, true);
+}
+
+void StudentWorld::spawnChunk(int chunk) {
+    // the first time, everything from the level file gets the next spawn orders. every time after that it gets the same
+    // ones back, and whatever the chunk's record says is gone or emptied stays that way
+    ChunkRecord& record = m_chunks[chunk];
+    if (!record.spawned)
+        record.firstOrder = m_nextSpawnOrder;
+    unsigned int order = record.firstOrder;
+    int columns = LevelStreamer::chunkColumns(*m_level, chunk);
+    for (int c = 0; c < columns; c++) {
+        for (int y = 0; y < m_level->getHeight(); y++) {
+            // calculate our x and y positions
+            int lx = (chunk * LevelStreamer::CHUNK_WIDTH + c) * SPRITE_WIDTH;
+            int ly = y * SPRITE_HEIGHT;
+            Level::GridEntry entry = m_chunkGrid[y * columns + c];
+            if (entry == Level::empty || entry == Level::peach) // peach is only created once, in init()
+                continue;
+            int k = static_cast<int>(order - record.firstOrder);
+            if (record.spawned && record.gone[k]) {
+                order++;
+                continue;
+            }
+            Actor* actor = nullptr;
+            int goodie = 0;
+            switch (entry) {
+            case Level::block:
+                actor = new Block(this, IID_BLOCK, lx, ly);
+                break;
+            case Level::pipe:
+                actor = new Pipe(this, IID_PIPE, lx, ly);
+                break;
+            case Level::goomba:
+                actor = new Goomba(this, IID_GOOMBA, lx, ly, randInt(0, 1) * 180);
+                break;
+            case Level::koopa:
+                actor = new Koopa(this, IID_KOOPA, lx, ly, randInt(0, 1) * 180);
+                break;
+            case Level::piranha:
+                actor = new Piranha(this, IID_PIRANHA, lx, ly, randInt(0, 1) * 180);
+                break;
+            case Level::mushroom_goodie_block:
+                goodie = 1;
+                break;
+            case Level::flower_goodie_block:
+                goodie = 2;
+                break;
+            case Level::star_goodie_block:
+                goodie = 3;
+                break;
+            case Level::flag:
+                actor = new Flag(this, IID_FLAG, lx, ly);
+                break;
+            case Level::mario:
+                actor = new Mario(this, IID_MARIO, lx, ly);
+                break;
+            default:
+                break;
+            };
+            if (goodie != 0) // a goodie block, unless it's already been bonked
+                actor = new Block(this, IID_BLOCK, lx, ly, 0, 2, 1.0, record.spawned && record.emptied[k] ? 0 : goodie);
+            if (actor == nullptr)
+                continue;
+            actor->setSpawnOrder(order++);
+            m_index.insert(actor);
+        }
     }
-    else { // touched flag
-        finishedLevel = true;
+    if (!record.spawned) {
+        record.spawned = true;
+        record.count = static_cast<int>(order - record.firstOrder);
+        record.gone.assign(record.count, false);
+        record.emptied.assign(record.count, false);
+        m_nextSpawnOrder = order;
+        m_chunksBySpawn.push_back(chunk);
+    }
+
+    // and then whatever was passing through when it got evicted
+    for (size_t i = 0; i < record.parked.size(); i++) {
+        const ParkedActor& parked = record.parked[i];
+        Actor* actor = makeActor(parked.imageID, parked.x, parked.y, parked.direction);
+        if (actor == nullptr) // only things that move end up here, and makeActor knows all of them
+            continue;
+        actor->setSpawnOrder(parked.spawnOrder);
+        m_index.insert(actor);
+    }
+    record.parked.clear(); // keeps its capacity for the next time the chunk gets evicted
+    m_loadedChunks.push_back(chunk);
+}
+
+void StudentWorld::evictChunk(int chunk) {
+    // everything whose left edge is inside the chunk goes, wherever it started out. the dead are left alone, they get
+    // deleted at the end of the tick anyway
+    const int chunkPixels = LevelStreamer::CHUNK_WIDTH * SPRITE_WIDTH;
+    int x1 = chunk * chunkPixels;
+    int x2 = x1 + chunkPixels - 1;
+    m_evicted.clear();
+    m_index.query(x1, -m_levelHeight, x2, 2 * m_levelHeight, [&](Actor* actor) {
+        int x = actor->getX();
+        if (actor != m_peach && actor->isAlive() && x >= x1 && x <= x2)
+            m_evicted.push_back(actor);
+        return false;
+    });
+
+    // anything from the level file that isn't here anymore has died or is somewhere else, and either way it shouldn't
+    // come back with the chunk. what is still here comes back from the file, except that bonked goodie blocks stay
+    // empty. everything else here gets written down as it is, and comes back exactly like that
+    ChunkRecord& record = m_chunks[chunk];
+    record.gone.assign(record.count, true);
+    for (size_t i = 0; i < m_evicted.size(); i++) {
+        Actor* actor = m_evicted[i];
+        if (chunkSpawnedFrom(actor) == chunk) {
+            int k = static_cast<int>(actor->getSpawnOrder() - record.firstOrder);
+            record.gone[k] = false;
+            if (actor->getID() == IID_BLOCK)
+                record.emptied[k] = !static_cast<Block*>(actor)->hasGoodie();
+        }
+        else {
+            ParkedActor parked = { actor->getX(), actor->getY(), actor->getSpawnOrder(), actor->getID(), actor->getDirection() };
+            record.parked.push_back(parked);
+        }
+        m_index.remove(actor);
+        delete actor;
     }
+}
 
-}
\ No newline at end of file
+int StudentWorld::chunkSpawnedFrom(Actor* actor) const {
+    // the last chunk to be first spawned before the actor's spawn order came up, if the actor is one of its
+    unsigned int order = actor->getSpawnOrder();
+    vector<int>::const_iterator after = upper_bound(m_chunksBySpawn.begin(), m_chunksBySpawn.end(), order,
+        [&](unsigned int o, int chunk) { return o < m_chunks[chunk].firstOrder; });
+    if (after == m_chunksBySpawn.begin())
+        return -1;
+    int chunk = *(after - 1);
+    return order - m_chunks[chunk].firstOrder < static_cast<unsigned int>(m_chunks[chunk].count) ? chunk : -1;
+}
+
+void StudentWorld::wakeActors() {
+    // everything whose sprite overlaps the activation region is awake this tick. asking the index means we only ever
+    // look at the cells near peach, no matter how many actors are asleep in the rest of the level
+    int px = m_peach->getX();
+    int py = m_peach->getY();
+    m_awake.clear();
+    m_index.query(px - m_activationMargin, py - m_activationMargin, px + SPRITE_WIDTH - 1 + m_activationMargin,
+        py + SPRITE_HEIGHT - 1 + m_activationMargin, [&](Actor* actor) {
+            if (actor != m_peach)
+                m_awake.push_back(actor);
+            return false;
+        });
+    // the index hands them back in cell order, so put them back in the order they were spawned
+    sort(m_awake.begin(), m_awake.end(), [](Actor* a, Actor* b) { return a->getSpawnOrder() < b->getSpawnOrder(); });
+}
+
+void StudentWorld::updateCamera() {
+    // center the camera on peach, but never show anything past the edges of the level
+    int camX = m_peach->getX() + SPRITE_WIDTH / 2 - VIEW_WIDTH / 2;
+    int camY = m_peach->getY() + SPRITE_HEIGHT / 2 - VIEW_HEIGHT / 2;
+    camX = max(0, min(camX, m_levelWidth - VIEW_WIDTH));
+    camY = max(0, min(camY, m_levelHeight - VIEW_HEIGHT));
+    setCameraOrigin(camX, camY);
+}
@@ -3,8 +3,15 @@
 
 #include "GameWorld.h"
 #include "Actor.h"
+#include "SpatialIndex.h"
+#include "Level.h"
+#include "GameEvent.h"
+#include "WorkerPool.h"
 #include <vector>
 #include <string>
+#include <memory>
+
+class LevelStreamer;
 
 // Students:  Add code to this file, StudentWorld.cpp, Actor.h, and Actor.cpp
 
@@ -16,17 +23,146 @@ public:
 	virtual int init();
 	virtual int move();
 	virtual void cleanUp();
-	Actor* isBlockingObject(int x, int y, bool includePeach = false, bool moving = true);
+	// collision queries for a sprite with its bottom-left corner at (x, y). kinds is any mix of ActorKind bits, and
+	// only live actors of those kinds are considered. findOverlap gives back the one that does something first (lowest
+	// spawn order) or nullptr; forEachOverlap calls visit(actor) for all of them, in no particular order, until visit
+	// returns true, and returns whether it stopped early
+	Actor* findOverlap(int x, int y, int kinds);
+	template <typename Visitor>
+	bool forEachOverlap(int x, int y, int kinds, Visitor visit) const {
+		countQuery();
+		return m_index.query(x, y, x + SPRITE_WIDTH - 1, y + SPRITE_HEIGHT - 1, [&](Actor* actor) {
+			return (actor->getKind() & kinds) != 0 && actor->isAlive() && visit(actor);
+		});
+	}
+	// moves a sprite at (x, y) by dx pixels sideways or dy pixels up/down (one of them has to be 0), stopping at the
+	// first live actor of the given kinds it runs into. x and y get updated to where it stopped, and whatever it ran
+	// into is returned (nullptr if it made it all the way). it looks at the whole path, not just the end, so nothing
+	// gets skipped over no matter how far it moves. an actor already overlapping the sprite counts as hit right away
+	Actor* sweep(int& x, int& y, int dx, int dy, int kinds);
+	// how many collision queries (findOverlap, forEachOverlap and sweep) have been made since the world was created
+	unsigned long long getQueryCount() const { return m_queries; }
 	Peach* getPeach() { return m_peach; }
 	bool isPeach(Actor* unknown) { return unknown == m_peach; }
+	// actors don't change the world (or each other) directly while they update, they post an event with one of these
+	void postScore(int points);
+	void postSound(int soundID);
+	void postBonk(Actor* target);
+	void postPowerup(int powerup); // for peach
 	void CreatePowerup(int goodie, int x, int y);
 	void CreateFireball(bool peach, int x, int y, int dir);
 	void CreateShell(int x, int y, int dir);
 	void NextLevel(bool mario);
+	// everything the actors posted during the last tick, in the order it happened
+	const std::vector<GameEvent>& getEvents() const { return m_events; }
+
+	// in a parallel update, every awake actor (everyone but peach) decides what to do at the same time, spread over
+	// all the cores, looking at the world as it was after peach moved. nothing they do (moving, dying, bonking, spawning)
+	// happens until they've all decided; then it gets applied one actor at a time in the usual order. that's different
+	// from a normal update in a few ways:
+	//  - actors don't see anyone else's moves or deaths from the same tick (or their own moves, for that matter)
+	//  - anything spawned during the tick first moves on the next one
+	//  - if an actor gets killed by someone earlier in the order, whatever it decided to do is thrown away
+	void setParallelUpdate(bool enabled) { m_parallel = enabled; }
+	bool deferringChanges() const { return m_deferring; } // true while the actors are deciding in a parallel update
+	void postMove(Actor* actor, int x, int y);
+	void postDeath(Actor* actor);
+	void actorMoved(Actor* actor, int oldX, int oldY) { m_index.move(actor, oldX, oldY); }
+	void actorDied(Actor* actor);
+	// actors further than this many pixels from peach are asleep: they don't do anything until she gets closer
+	void setActivationMargin(int pixels) { m_activationMargin = pixels; }
+	virtual void getVisibleObjects(int x1, int y1, int x2, int y2, std::vector<GraphObject*>& objects);
+	// what the camera sees, for playing without a window. both write into the caller's buffer, top row first, and never
+	// allocate. observeGrid fills GRID_WIDTH * GRID_HEIGHT bytes, one per sprite-sized cell: 0 if it's empty, otherwise
+	// 1 + the image ID (IID_PEACH etc.) of what's centered there, with peach beating anything else and otherwise whatever
+	// is drawn in front. observeRGB fills width * height * 3 bytes with the view scaled to width x height, every object
+	// drawn as a block of its own flat colour; a pixel gets the colour of whatever is in front at its center
+	void observeGrid(unsigned char* cells) const;
+	void observeRGB(unsigned char* pixels, int width, int height) const;
+	// gives this world its own generator for randInt, seeded with seed, instead of the one every world shares. worlds
+	// that move at the same time on different threads need this, and it keeps each of their runs repeatable
+	void seedOwnRandom(unsigned int seed) { m_random.seed(seed); m_ownRandom = true; }
+	// what our actors use to find us (see Actor::registerWorld). -1 if every slot was taken, and then init() always fails
+	int getWorldSlot() const { return m_worldSlot; }
+	// plays level (read whole by Level::loadLevel) whenever we're on level number levelNumber, instead of streaming that
+	// level's file. chunks get copied straight out of its grid when they're needed, so init() doesn't touch the disk and
+	// there's no loader thread. nothing changes the level, so any number of worlds can share it (WorldBatch's all do)
+	void shareLevel(int levelNumber, std::shared_ptr<const Level> level) { m_sharedLevelNumber = levelNumber; m_sharedLevel = level; }
+	static std::string levelFileName(int levelNumber); // level01.txt and so on
 
 private:
+	int m_worldSlot;
 	Peach* m_peach;
-	std::vector<Actor*> m_actors;
+	SpatialIndex m_index; // owns every actor (including peach), bucketed by position
+	std::vector<Actor*> m_awake; // actors inside the activation region this tick, in spawn order
+	std::vector<Actor*> m_dead; // actors that died this tick, deleted at the end of move()
+	unsigned int m_nextSpawnOrder; // handed out to actors as they get added
+	int m_activationMargin;
+	std::default_random_engine m_random; // what randInt uses while we init() or move(), if m_ownRandom
+	bool m_ownRandom;
+	mutable unsigned long long m_queries; // doesn't include the batches of a parallel update until they're all done
+	// while the actors decide in a parallel update, each thread counts its batch's queries wherever this points (see
+	// updateBatch), so they don't all fight over m_queries
+	static thread_local unsigned long long* t_queries;
+	void countQuery() const { ++*(m_deferring ? t_queries : &m_queries); }
+	int m_levelWidth, m_levelHeight; // in pixels
+	std::shared_ptr<const Level> m_level; // opened, but its grid only gets read a chunk at a time
+	std::unique_ptr<LevelStreamer> m_streamer; // not there if m_level is the shared one
+	std::shared_ptr<const Level> m_sharedLevel;
+	int m_sharedLevelNumber;
+	std::vector<int> m_loadedChunks; // chunks whose actors are in the index
+	std::vector<Level::GridEntry> m_chunkGrid; // reused for every chunk we spawn
+	// an evicted chunk's actors get deleted, and it's spawned from the level file again when it comes back. this is what
+	// it has to remember in the meantime so it comes back the way it was left (bonked blocks stay empty, dead enemies stay
+	// dead, and nothing that walked in or out of it is lost or doubled)
+	struct ParkedActor { // an actor that isn't from this chunk, but was in it when it got evicted
+		int x, y;
+		unsigned int spawnOrder;
+		int imageID, direction;
+	};
+	struct ChunkRecord {
+		bool spawned; // everything below only means something once the chunk has been spawned
+		unsigned int firstOrder; // what the level file puts here gets spawn orders firstOrder, firstOrder + 1, ...
+		int count; // ... up to firstOrder + count - 1, in the order spawnChunk goes through the grid
+		std::vector<bool> gone; // by spawn order - firstOrder: killed, or somewhere else, so don't spawn it again
+		std::vector<bool> emptied; // same, for goodie blocks whose goodie has been dropped
+		std::vector<ParkedActor> parked;
+	};
+	std::vector<ChunkRecord> m_chunks;
+	std::vector<int> m_chunksBySpawn; // chunks in the order they were first spawned, so also by firstOrder
+	std::vector<Actor*> m_evicted; // reused by every evictChunk
+	std::vector<GameEvent> m_events; // posted this tick
+	size_t m_nextEvent; // first event that hasn't been applied yet
+	Actor* m_updating; // whose doSomething() (or bonk()) is running, so events know where they came from
+	bool m_parallel; // see setParallelUpdate()
+	bool m_deferring;
+	std::unique_ptr<WorkerPool> m_pool; // started the first time we do a parallel update
+	size_t m_batchActors; // how many awake actors are deciding in a parallel update
+	int m_numBatches; // they get split into this many runs of neighbours
+	std::vector<std::vector<GameEvent>> m_batchEvents; // what each batch posted while deciding
+	std::vector<unsigned long long> m_batchQueries; // and how many collision queries it made
+	void post(GameEvent::Type type, Actor* target, int value, int x = 0, int y = 0, int dir = 0);
+	void update(Actor* actor);
+	bool updateInParallel();
+	static void updateBatch(void* world, int batch);
+	size_t batchStart(int batch) const;
+	int peachDied();
+	void applyEvents();
+	void applyTickEvents();
+	void spawnActor(int imageID, int x, int y, int dir);
+	void addActor(Actor* actor);
+	bool streamChunks();
+	bool readChunk(int chunk); // into m_chunkGrid
+	void spawnChunk(int chunk);
+	void evictChunk(int chunk);
+	int chunkSpawnedFrom(Actor* actor) const; // -1 if it didn't come out of the level file
+	Actor* makeActor(int imageID, int x, int y, int dir);
+	void wakeActors();
+	void updateCamera();
+	void updateStatusText();
+	// what the status text was last built from, so it only gets rebuilt when one of them changes
+	int m_statLives, m_statLevel, m_statScore, m_statBoosts;
+	char m_statText[80];
 	bool finishedLevel; // denotes whether we finished our current level
 	bool finishedGame; // denotes whether we finished the entire game
 };
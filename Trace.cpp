@@ -0,0 +1,185 @@
+#include "Trace.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <vector>
+using namespace std;
+
+static const int DETAIL_SIZE = 40; // keeps an event at 64 bytes; longer details keep their end, which is where file names are
+
+struct TraceEvent {
+	const char* name;
+	long long start, duration; // in nanoseconds, duration < 0 for a mark
+	char detail[DETAIL_SIZE];
+};
+
+// a thread's ring buffer. when a thread exits its buffer goes to the next new thread, so threads that come and go (a
+// level streamer for every level) don't pile up buffers; they just share a row in the trace
+struct ThreadLog {
+	int id;
+	bool inUse;
+	const char* name;
+	unsigned long long count; // events ever recorded since start(), the newest is at (count - 1) % EVENTS_PER_THREAD
+	vector<TraceEvent> events;
+};
+
+// never freed, so threads that are still around while the program exits can't outlive it
+static mutex& logsMutex() {
+	static mutex* m = new mutex;
+	return *m;
+}
+
+static vector<ThreadLog*>& logs() {
+	static vector<ThreadLog*>* l = new vector<ThreadLog*>;
+	return *l;
+}
+
+static chrono::steady_clock::time_point origin;
+
+// the buffer the thread got and what it wants to be called, handing the buffer back when the thread exits
+struct ThreadSlot {
+	ThreadLog* log;
+	const char* name;
+	~ThreadSlot() {
+		if (log != nullptr) {
+			lock_guard<mutex> lock(logsMutex());
+			log->inUse = false;
+		}
+	}
+};
+static thread_local ThreadSlot t_slot = { nullptr, nullptr };
+
+static ThreadLog* threadLog() {
+	if (t_slot.log != nullptr)
+		return t_slot.log;
+	lock_guard<mutex> lock(logsMutex());
+	vector<ThreadLog*>& all = logs();
+	for (size_t i = 0; i < all.size() && t_slot.log == nullptr; i++)
+		if (!all[i]->inUse)
+			t_slot.log = all[i];
+	if (t_slot.log == nullptr) { // the only allocation a thread ever makes for tracing
+		ThreadLog* log = new ThreadLog;
+		log->id = static_cast<int>(all.size()) + 1;
+		log->count = 0;
+		log->events.resize(Trace::EVENTS_PER_THREAD);
+		all.push_back(log);
+		t_slot.log = log;
+	}
+	t_slot.log->inUse = true;
+	t_slot.log->name = t_slot.name;
+	return t_slot.log;
+}
+
+static void writeString(ostream& out, const char* s) {
+	out << '"';
+	for (; *s != '\0'; s++) {
+		if (*s == '"' || *s == '\\')
+			out << '\\';
+		if (static_cast<unsigned char>(*s) >= ' ')
+			out << *s;
+	}
+	out << '"';
+}
+
+// timestamps go out in microseconds
+static void writeTime(ostream& out, const char* field, long long ns) {
+	char buf[32];
+	snprintf(buf, sizeof(buf), ",\"%s\":%.3f", field, ns / 1000.0);
+	out << buf;
+}
+
+atomic<bool> Trace::s_tracing(false);
+
+long long Trace::now() {
+	return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - origin).count();
+}
+
+void Trace::record(const char* name, const char* detail, long long start, long long duration) {
+	ThreadLog* log = threadLog();
+	TraceEvent& e = log->events[log->count++ % EVENTS_PER_THREAD];
+	e.name = name;
+	e.start = start;
+	e.duration = duration;
+	e.detail[0] = '\0';
+	if (detail != nullptr) {
+		size_t length = strlen(detail);
+		if (length >= DETAIL_SIZE) {
+			detail += length - (DETAIL_SIZE - 1);
+			length = DETAIL_SIZE - 1;
+		}
+		memcpy(e.detail, detail, length);
+		e.detail[length] = '\0';
+	}
+}
+
+void Trace::mark(const char* name, const char* detail) {
+	if (tracing())
+		record(name, detail, now(), -1);
+}
+
+void Trace::nameThread(const char* name) {
+	t_slot.name = name;
+	if (t_slot.log != nullptr)
+		t_slot.log->name = name;
+}
+
+void Trace::start() {
+	lock_guard<mutex> lock(logsMutex());
+	vector<ThreadLog*>& all = logs();
+	for (size_t i = 0; i < all.size(); i++)
+		all[i]->count = 0;
+	origin = chrono::steady_clock::now();
+	s_tracing.store(true);
+}
+
+bool Trace::stop(const char* fileName) {
+	s_tracing.store(false);
+	ofstream out(fileName);
+	if (!out)
+		return false;
+
+	lock_guard<mutex> lock(logsMutex());
+	vector<ThreadLog*>& all = logs();
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+	bool first = true;
+	for (size_t i = 0; i < all.size(); i++) {
+		const ThreadLog& log = *all[i];
+		if (log.count == 0)
+			continue;
+		out << (first ? "\n" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << log.id << ",\"args\":{\"name\":";
+		first = false;
+		if (log.name != nullptr)
+			writeString(out, log.name);
+		else
+			out << "\"thread " << log.id << '"';
+		out << "}}";
+
+		// only the last EVENTS_PER_THREAD events are still there
+		unsigned long long begin = log.count > static_cast<unsigned long long>(EVENTS_PER_THREAD) ? log.count - EVENTS_PER_THREAD : 0;
+		for (unsigned long long n = begin; n < log.count; n++) {
+			const TraceEvent& e = log.events[n % EVENTS_PER_THREAD];
+			out << ",\n{\"name\":";
+			writeString(out, e.name);
+			if (e.duration >= 0) {
+				out << ",\"ph\":\"X\"";
+				writeTime(out, "ts", e.start);
+				writeTime(out, "dur", e.duration);
+			}
+			else {
+				out << ",\"ph\":\"i\",\"s\":\"t\"";
+				writeTime(out, "ts", e.start);
+			}
+			out << ",\"pid\":1,\"tid\":" << log.id;
+			if (e.detail[0] != '\0') {
+				out << ",\"args\":{\"detail\":";
+				writeString(out, e.detail);
+				out << '}';
+			}
+			out << '}';
+		}
+	}
+	out << "\n]}\n";
+	return static_cast<bool>(out);
+}
@@ -0,0 +1,65 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <atomic>
+
+// Records what every thread was doing when, as Chrome trace JSON (open it in chrome://tracing or ui.perfetto.dev).
+// Each thread writes into its own ring buffer that keeps its last EVENTS_PER_THREAD events, so recording an event
+// takes no locks and doesn't allocate after the thread's first one. When nobody is tracing, a Scope costs one relaxed
+// load, so the spans stay in the game for good. The game traces when run with SPS_TRACE=file, the benchmark with
+// --trace file.
+
+class Trace {
+public:
+	static const int EVENTS_PER_THREAD = 1 << 16;
+
+	// a span on this thread's timeline from the constructor to the destructor, called name and labelled with detail if
+	// there is one. both strings have to stay around until the span ends. set() ends the span and starts the next one
+	class Scope {
+	public:
+		explicit Scope(const char* name, const char* detail = nullptr) { begin(name, detail); }
+		~Scope() { end(); }
+		void set(const char* name, const char* detail = nullptr) {
+			end();
+			begin(name, detail);
+		}
+
+	private:
+		const char* m_name; // nullptr if we weren't tracing when the span started
+		const char* m_detail;
+		long long m_start;
+
+		void begin(const char* name, const char* detail) {
+			m_name = nullptr;
+			if (tracing()) {
+				m_name = name;
+				m_detail = detail;
+				m_start = now();
+			}
+		}
+		void end() {
+			if (m_name != nullptr)
+				record(m_name, m_detail, m_start, now() - m_start);
+		}
+
+		Scope(const Scope&);
+		Scope& operator=(const Scope&);
+	};
+
+	static bool tracing() { return s_tracing.load(std::memory_order_relaxed); }
+	static void mark(const char* name, const char* detail = nullptr); // something that happens at an instant, like a sound request
+	static void nameThread(const char* name); // what this thread shows up as; the string has to stay around
+
+	static void start(); // throws away anything recorded before
+	// stops tracing and writes out everything still in the buffers. the other threads shouldn't be in the middle of a
+	// span while this runs, so call it between ticks (or once they're gone). returns false if the file can't be written
+	static bool stop(const char* fileName);
+
+private:
+	static std::atomic<bool> s_tracing;
+
+	static long long now(); // nanoseconds since start()
+	static void record(const char* name, const char* detail, long long start, long long duration); // duration < 0 for a mark
+};
+
+#endif // TRACE_H_
@@ -0,0 +1,66 @@
+#include "WorkerPool.h"
+#include "Trace.h"
+using namespace std;
+
+WorkerPool::WorkerPool(int threads)
+	: m_batch(0), m_task(nullptr), m_context(nullptr), m_count(0), m_next(0), m_busy(0), m_quit(false) {
+	if (threads <= 0)
+		threads = static_cast<int>(thread::hardware_concurrency()) - 1;
+	for (int i = 0; i < threads; i++)
+		m_threads.push_back(thread(&WorkerPool::work, this));
+}
+
+WorkerPool::~WorkerPool() {
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_quit = true;
+	}
+	m_start.notify_all();
+	for (size_t i = 0; i < m_threads.size(); i++)
+		m_threads[i].join();
+}
+
+void WorkerPool::run(int count, Task task, void* context) {
+	if (m_threads.empty() || count <= 1) { // not worth waking anybody up
+		for (int i = 0; i < count; i++)
+			task(context, i);
+		return;
+	}
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_task = task;
+		m_context = context;
+		m_count = count;
+		m_next = 0;
+		m_busy = static_cast<int>(m_threads.size());
+		m_batch++;
+	}
+	m_start.notify_all();
+	runTasks();
+
+	// the tasks are all handed out, but the workers might still be in the middle of theirs
+	unique_lock<mutex> lock(m_mutex);
+	m_finished.wait(lock, [&] { return m_busy == 0; });
+}
+
+void WorkerPool::work() {
+	Trace::nameThread("worker");
+	unsigned int seen = 0;
+	unique_lock<mutex> lock(m_mutex);
+	for (;;) {
+		m_start.wait(lock, [&] { return m_quit || m_batch != seen; });
+		if (m_quit)
+			return;
+		seen = m_batch;
+		lock.unlock();
+		runTasks();
+		lock.lock();
+		if (--m_busy == 0)
+			m_finished.notify_one();
+	}
+}
+
+void WorkerPool::runTasks() {
+	for (int i = m_next++; i < m_count; i = m_next++)
+		m_task(m_context, i);
+}
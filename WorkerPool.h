@@ -0,0 +1,44 @@
+#ifndef WORKERPOOL_H_
+#define WORKERPOOL_H_
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+// A handful of threads that sit around waiting to be handed a batch of tasks. The thread that calls run() helps out
+// and doesn't return until the whole batch is done, so a batch can be handed out every tick without starting threads.
+
+class WorkerPool {
+public:
+	typedef void (*Task)(void* context, int index);
+
+	explicit WorkerPool(int threads = 0); // extra threads besides the caller's, 0 means one less than the number of cores
+	~WorkerPool();
+	int numThreads() const { return static_cast<int>(m_threads.size()) + 1; } // counting the caller
+
+	// calls task(context, i) once for every i in [0, count), in no particular order and on any of the threads
+	void run(int count, Task task, void* context);
+
+private:
+	std::vector<std::thread> m_threads;
+	std::mutex m_mutex;
+	std::condition_variable m_start, m_finished;
+	unsigned int m_batch; // bumped for every run(), which is what wakes the workers up
+	Task m_task;
+	void* m_context;
+	int m_count;
+	std::atomic<int> m_next; // next task index to hand out
+	int m_busy; // workers still working on the current batch
+	bool m_quit;
+
+	void work();
+	void runTasks();
+
+	// Prevent copying or assigning WorkerPools
+	WorkerPool(const WorkerPool&);
+	WorkerPool& operator=(const WorkerPool&);
+};
+
+#endif // WORKERPOOL_H_
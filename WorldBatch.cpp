@@ -0,0 +1,92 @@
+#include "WorldBatch.h"
+#include "GameConstants.h"
+#include "Trace.h"
+using namespace std;
+
+WorldBatch::WorldBatch(const string& assetPath, int numWorlds, int obsWidth, int obsHeight, unsigned int seed,
+					   int startLevel, int threads)
+	: m_pool(threads), m_obsWidth(obsWidth), m_obsHeight(obsHeight), m_startLevel(startLevel), m_keys(nullptr),
+	  m_restarts(0), m_ready(false) {
+	// every world plays the same level over and over, so read it once and have them all spawn out of that (see
+	// StudentWorld::shareLevel). if it can't be read, each world finds that out for itself in reset()
+	shared_ptr<Level> level(new Level(assetPath));
+	if (level->loadLevel(StudentWorld::levelFileName(startLevel)) != Level::load_success)
+		level.reset();
+	for (int i = 0; i < numWorlds; i++) {
+		m_worlds.push_back(unique_ptr<StudentWorld>(new StudentWorld(assetPath)));
+		m_worlds[i]->seedOwnRandom(seed + i);
+		if (level)
+			m_worlds[i]->shareLevel(startLevel, level);
+	}
+	m_obsSize = obsWidth == 0 ? GRID_WIDTH * GRID_HEIGHT : obsWidth * obsHeight * 3;
+
+	// rewards and statuses are 4 bytes each and come first, so everything in the block lines up without any padding
+	m_statusOffset = numWorlds * sizeof(float);
+	m_obsOffset = m_statusOffset + numWorlds * sizeof(int);
+	m_block.resize(m_obsOffset + static_cast<size_t>(numWorlds) * m_obsSize);
+}
+
+bool WorldBatch::reset() {
+	Trace::Scope span("reset batch");
+	m_pool.run(size(), resetWorld, this);
+	m_ready = true;
+	for (int i = 0; i < size(); i++)
+		if (*statusOf(i) == GWSTATUS_LEVEL_ERROR)
+			m_ready = false;
+	return m_ready;
+}
+
+bool WorldBatch::step(const int* keys) {
+	if (!m_ready)
+		return false;
+	Trace::Scope span("step batch");
+	m_keys = keys;
+	m_pool.run(size(), stepWorld, this);
+	m_keys = nullptr;
+	for (int i = 0; i < size(); i++)
+		if (*statusOf(i) == GWSTATUS_LEVEL_ERROR)
+			m_ready = false;
+	return m_ready;
+}
+
+int WorldBatch::restart(int i) {
+	StudentWorld& w = *m_worlds[i];
+	w.cleanUp();
+	w.restartGame(m_startLevel);
+	return w.init();
+}
+
+void WorldBatch::observe(int i) {
+	unsigned char* out = m_block.data() + m_obsOffset + static_cast<size_t>(i) * m_obsSize;
+	if (m_obsWidth == 0)
+		m_worlds[i]->observeGrid(out);
+	else
+		m_worlds[i]->observeRGB(out, m_obsWidth, m_obsHeight);
+}
+
+void WorldBatch::resetWorld(void* batch, int i) {
+	WorldBatch& b = *static_cast<WorldBatch*>(batch);
+	int status = b.restart(i);
+	*b.rewardOf(i) = 0;
+	*b.statusOf(i) = status == GWSTATUS_CONTINUE_GAME ? GWSTATUS_CONTINUE_GAME : GWSTATUS_LEVEL_ERROR;
+	b.observe(i);
+}
+
+void WorldBatch::stepWorld(void* batch, int i) {
+	WorldBatch& b = *static_cast<WorldBatch*>(batch);
+	StudentWorld& w = *b.m_worlds[i];
+	if (b.m_keys != nullptr && b.m_keys[i] >= 0)
+		w.pressKey(b.m_keys[i]);
+	int score = w.getScore();
+	int status = w.move();
+	*b.rewardOf(i) = static_cast<float>(w.getScore() - score);
+
+	if (status != GWSTATUS_CONTINUE_GAME) {
+		Trace::Scope span("restart world");
+		b.m_restarts.fetch_add(1, memory_order_relaxed);
+		if (b.restart(i) != GWSTATUS_CONTINUE_GAME)
+			status = GWSTATUS_LEVEL_ERROR;
+	}
+	*b.statusOf(i) = status;
+	b.observe(i);
+}
@@ -0,0 +1,78 @@
+#ifndef WORLDBATCH_H_
+#define WORLDBATCH_H_
+
+#include "StudentWorld.h"
+#include "WorkerPool.h"
+#include <vector>
+#include <string>
+#include <memory>
+#include <atomic>
+
+// A batch of headless worlds that move in lock-step, for agents that play a lot of games at once. Every step() moves
+// all of them one tick, spread over a WorkerPool (whichever thread is free takes the next world, so a world that's busy
+// loading a level doesn't hold the others up), and writes what happened into one block allocated up front: a reward,
+// a status and an observation per world. A world whose move() ends its game (peach died, finished the level, won) is
+// restarted right away on its starting level, and its observation is of the restarted world.
+//
+// The level gets read once, when the batch is made, and every world spawns its chunks out of that copy, so restarting
+// a world never goes to the disk or starts a loader thread (see StudentWorld::shareLevel).
+//
+// Each world draws from its own randInt generator, so a batch with the same seed and keys plays out the same no
+// matter how many threads there are. Worlds get created and destroyed only by the batch's own thread, since the
+// slots actors use to find their world (see Actor::registerWorld) aren't safe to change while other worlds move.
+// Nothing else is shared between the worlds as long as GraphObject tracking stays off, which it does unless a
+// GameController is running in the same process.
+
+class WorldBatch {
+public:
+	// numWorlds worlds playing level startLevel out of assetPath. observations are StudentWorld::observeGrid's if
+	// obsWidth is 0, otherwise observeRGB's at obsWidth x obsHeight. world i's generator is seeded with seed + i, and
+	// threads is handed to the WorkerPool. call reset() before the first step()
+	WorldBatch(const std::string& assetPath, int numWorlds, int obsWidth = 0, int obsHeight = 0, unsigned int seed = 1,
+			   int startLevel = 1, int threads = 0);
+	int size() const { return static_cast<int>(m_worlds.size()); }
+	int numThreads() const { return m_pool.numThreads(); }
+	StudentWorld& world(int i) { return *m_worlds[i]; }
+
+	// (re)starts every world. false if a level can't be loaded, which also makes step() refuse to do anything
+	bool reset();
+	// presses keys[i] in world i (nothing if it's negative, or for all of them if keys is nullptr), moves every world
+	// one tick and restarts the ones whose game ended. false if a restart couldn't load the level
+	bool step(const int* keys);
+	long long getRestarts() const { return m_restarts; } // since the batch was made
+
+	// all of these point into the one block, and get rewritten by every reset() and step()
+	int observationSize() const { return m_obsSize; } // bytes per world
+	const unsigned char* observations() const { return m_block.data() + m_obsOffset; } // world i's at i * observationSize()
+	const float* rewards() const { return reinterpret_cast<const float*>(m_block.data()); } // points scored last step
+	// the GWSTATUS_ that each world's last move() returned. anything but GWSTATUS_CONTINUE_GAME means it's been restarted
+	// since (or that it couldn't be, if it's GWSTATUS_LEVEL_ERROR)
+	const int* statuses() const { return reinterpret_cast<const int*>(m_block.data() + m_statusOffset); }
+	// the whole block, rewards then statuses then observations, for handing to someone else in one piece
+	const unsigned char* data() const { return m_block.data(); }
+	size_t dataSize() const { return m_block.size(); }
+
+private:
+	std::vector<std::unique_ptr<StudentWorld>> m_worlds;
+	WorkerPool m_pool;
+	int m_obsWidth, m_obsHeight, m_obsSize;
+	int m_startLevel;
+	std::vector<unsigned char> m_block;
+	size_t m_statusOffset, m_obsOffset;
+	const int* m_keys; // what the step in progress presses
+	std::atomic<long long> m_restarts;
+	bool m_ready; // reset() worked and no restart has failed since
+
+	float* rewardOf(int i) { return reinterpret_cast<float*>(m_block.data()) + i; }
+	int* statusOf(int i) { return reinterpret_cast<int*>(m_block.data() + m_statusOffset) + i; }
+	int restart(int i); // GWSTATUS_CONTINUE_GAME if it worked
+	void observe(int i);
+	static void resetWorld(void* batch, int i);
+	static void stepWorld(void* batch, int i);
+
+	// Prevent copying or assigning WorldBatches
+	WorldBatch(const WorldBatch&);
+	WorldBatch& operator=(const WorldBatch&);
+};
+
+#endif // WORLDBATCH_H_
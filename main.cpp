@@ -1,4 +1,5 @@
 #include "GameController.h"
+#include "AssetPack.h"
 #include <iostream>
 #include <fstream>
 #include <string>
@@ -43,9 +44,11 @@ int main(int argc, char* argv[])
         assetPath += '/';
     }
     {
+		  // either the asset pack or the loose files have to be there
 		const string someAsset = "star.tga";
+		ifstream pack(assetPath + ASSET_PACK_NAME);
 		ifstream ifs(assetPath + someAsset);
-		if (!ifs)
+		if (!pack  &&  !ifs)
 		{
 			cout << "Cannot find " << someAsset << " in ";
 			cout << (assetDirectory.empty() ? "current directory" : assetDirectory) << endl;